@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stddef.h>
+#
+#include <new>
+
+namespace Tara {
+
+class MemoryPool;
+struct ArenaPage;
+struct ArenaLargeBlock;
+
+class FiberArena final
+{
+  FiberArena(const FiberArena &other) = delete;
+  void operator=(const FiberArena &other) = delete;
+
+public:
+  FiberArena(MemoryPool *pagePool, size_t pageSize);
+  ~FiberArena();
+
+  void *allocate(size_t size, size_t alignment = alignof(max_align_t));
+  void reset();
+
+private:
+  MemoryPool *const pagePool_;
+  const size_t pageSize_;
+  ArenaPage *lastPage_;
+  ArenaLargeBlock *lastLargeBlock_;
+  unsigned char *top_;
+  unsigned char *limit_;
+
+  void *allocateLargeBlock(size_t size, size_t alignment);
+  void increasePages();
+};
+
+FiberArena &Arena();
+
+template<typename TYPE>
+class ArenaAllocator
+{
+public:
+  typedef TYPE value_type;
+
+  ArenaAllocator() : arena_(&Arena()) {}
+  explicit ArenaAllocator(FiberArena *arena) : arena_(arena) {}
+
+  template<typename OTHER_TYPE>
+  ArenaAllocator(const ArenaAllocator<OTHER_TYPE> &other)
+    : arena_(other.getArena())
+  {}
+
+  FiberArena *getArena() const { return arena_; }
+
+  TYPE *allocate(size_t length)
+  {
+    if (length > static_cast<size_t>(-1) / sizeof(TYPE)) {
+      throw std::bad_alloc();
+    }
+    return static_cast<TYPE *>(arena_->allocate(length * sizeof(TYPE),
+                                                alignof(TYPE)));
+  }
+
+  void deallocate(TYPE *, size_t) {}
+
+private:
+  FiberArena *arena_;
+};
+
+template<typename TYPE1, typename TYPE2>
+inline bool operator==(const ArenaAllocator<TYPE1> &allocator1,
+                       const ArenaAllocator<TYPE2> &allocator2)
+{
+  return allocator1.getArena() == allocator2.getArena();
+}
+
+template<typename TYPE1, typename TYPE2>
+inline bool operator!=(const ArenaAllocator<TYPE1> &allocator1,
+                       const ArenaAllocator<TYPE2> &allocator2)
+{
+  return allocator1.getArena() != allocator2.getArena();
+}
+
+} // namespace Tara
@@ -6,4 +6,13 @@ namespace Tara {
 
 typedef std::function<void ()> Coroutine;
 
+enum class StackSize
+{
+  Small,
+  Medium,
+  Large,
+  Huge,
+  Auto
+};
+
 } // namespace Tara
@@ -0,0 +1,11 @@
+#pragma once
+
+namespace Tara {
+
+void CreateScheduler();
+void DestroyScheduler();
+bool RunOnce(int timeout);
+int GetPollFD();
+int GetPollTimeout();
+
+} // namespace Tara
@@ -0,0 +1,67 @@
+#pragma once
+
+namespace Tara {
+
+class Histogram final
+{
+public:
+  static constexpr unsigned int SubBucketBits = 4;
+  static constexpr unsigned int SubBucketCount = 1 << SubBucketBits;
+  static constexpr unsigned int MaxValueBits = 40;
+  static constexpr unsigned int BucketCount = (MaxValueBits - SubBucketBits
+                                               + 1) * SubBucketCount;
+
+  Histogram() { reset(); }
+
+  unsigned long long getCount() const { return count_; }
+  unsigned long long getSum() const { return sum_; }
+  unsigned long long getMin() const { return count_ == 0 ? 0 : min_; }
+  unsigned long long getMax() const { return max_; }
+  unsigned long long getBucketCount(unsigned int bucketIndex) const
+  { return counts_[bucketIndex]; }
+
+  static unsigned int GetBucketIndex(unsigned long long value);
+  static unsigned long long GetBucketLowerBound(unsigned int bucketIndex);
+  static unsigned long long GetBucketUpperBound(unsigned int bucketIndex);
+
+  void record(unsigned long long value);
+
+  void reset();
+  void merge(const Histogram &other);
+  unsigned long long getPercentile(double percentile) const;
+
+private:
+  unsigned long long count_;
+  unsigned long long sum_;
+  unsigned long long min_;
+  unsigned long long max_;
+  unsigned long long counts_[BucketCount];
+};
+
+inline unsigned int Histogram::GetBucketIndex(unsigned long long value)
+{
+  if (value < SubBucketCount) {
+    return value;
+  }
+  if (value >> MaxValueBits != 0) {
+    return BucketCount - 1;
+  }
+  unsigned int exponent = 63 - __builtin_clzll(value);
+  unsigned int shift = exponent - SubBucketBits;
+  return (shift + 1) * SubBucketCount + (value >> shift) - SubBucketCount;
+}
+
+inline void Histogram::record(unsigned long long value)
+{
+  ++counts_[GetBucketIndex(value)];
+  ++count_;
+  sum_ += value;
+  if (value < min_) {
+    min_ = value;
+  }
+  if (value > max_) {
+    max_ = value;
+  }
+}
+
+} // namespace Tara
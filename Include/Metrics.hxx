@@ -0,0 +1,43 @@
+#pragma once
+
+#include <sys/socket.h>
+#
+#include "Histogram.hxx"
+
+namespace Tara {
+
+struct SchedulerMetrics final
+{
+  unsigned long long dispatchCount;
+  unsigned long long fiberCount;
+  unsigned long long cachedFiberCount;
+  unsigned long long readyFiberCount;
+  unsigned long long createdFiberCount;
+  unsigned long long recycledFiberCount;
+  unsigned long long destroyedFiberCount;
+  unsigned long long pollCount;
+  unsigned long long pollEventCount;
+  unsigned long long pollControlCount;
+  unsigned long long timerCount;
+  unsigned long long asyncJobCount;
+  unsigned long long readyLag;
+};
+
+struct SchedulerHistograms final
+{
+  Histogram readabilityWait;
+  Histogram writabilityWait;
+  Histogram runSlice;
+  Histogram dispatchDelay;
+  Histogram asyncQueueWait;
+  Histogram asyncService;
+
+  void merge(const SchedulerHistograms &other);
+};
+
+int GetSchedulerMetrics(SchedulerMetrics *metrics);
+int GetSchedulerHistograms(SchedulerHistograms *histograms);
+int ServeMetrics(const sockaddr *addr, socklen_t addrlen);
+int StopMetrics(int fd);
+
+} // namespace Tara
@@ -7,11 +7,67 @@
 
 namespace Tara {
 
-void Call(const Coroutine &coroutine);
-void Call(Coroutine &&coroutine);
+struct FiberGroupStatistics final
+{
+  unsigned int weight;
+  unsigned long dispatchCount;
+  unsigned long long cpuTime;
+};
+
+struct FiberStatistics final
+{
+  unsigned long switchCount;
+  unsigned long long cpuTime;
+  unsigned long long waitTime;
+  unsigned long long readByteCount;
+  unsigned long long writtenByteCount;
+};
+
+struct SpawnSiteStatistics final
+{
+  const void *address;
+  unsigned long fiberCount;
+  FiberStatistics total;
+};
+
+void Call(const Coroutine &coroutine, StackSize stackSize = StackSize::Medium);
+void Call(Coroutine &&coroutine, StackSize stackSize = StackSize::Medium);
+void CallNow(const Coroutine &coroutine,
+             StackSize stackSize = StackSize::Medium);
+void CallNow(Coroutine &&coroutine, StackSize stackSize = StackSize::Medium);
 void Yield();
+void Checkpoint();
 void Sleep(int duration);
 [[noreturn]] void Exit();
+[[noreturn]] void QuickExit();
+
+void SetFiberCacheCapacity(unsigned int capacity);
+void SetFiberStackReleasing(bool enabled);
+void SetStackProfiling(bool enabled);
+void ReportStackUsage();
+void SetFiberAccounting(bool enabled);
+int GetFiberStatistics(FiberStatistics *statistics);
+unsigned int GetSpawnSiteStatistics(SpawnSiteStatistics *statisticsList,
+                                    unsigned int maxCount);
+void ReportFiberAccounting();
+void SetIOBudget(unsigned int operationCount, size_t byteCount);
+void SetPollInterval(unsigned int dispatchCount, int duration);
+void SetVirtualClock(bool enabled);
+unsigned long long Now();
+void Prewarm(unsigned int fiberCount, unsigned int fdCount,
+             StackSize stackSize = StackSize::Medium);
+void SetOverloadThreshold(int lag, unsigned int readyCount);
+bool Overloaded();
+void EnablePreemption(int timeSlice);
+void DisablePreemption();
+void AllowAsyncPreemption(bool allowed);
+int StartWatchdog(int threshold);
+void StopWatchdog();
+int CreateFiberGroup(unsigned int weight);
+int SetFiberGroupWeight(int group, unsigned int weight);
+int JoinFiberGroup(int group);
+int GetFiberGroup();
+int GetFiberGroupStatistics(int group, FiberGroupStatistics *statistics);
 
 int Open(const char *path, int flags, mode_t mode = 0);
 int Pipe2(int *fds, int flags);
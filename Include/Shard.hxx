@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+#
+#include "Coroutine.hxx"
+
+namespace Tara {
+
+struct FutureState;
+
+class Future final
+{
+  Future(const Future &other) = delete;
+  void operator=(const Future &other) = delete;
+
+public:
+  Future() {}
+  explicit Future(const std::shared_ptr<FutureState> &state) : state_(state) {}
+  Future(Future &&other) : state_(std::move(other.state_)) {}
+
+  Future &operator=(Future &&other) { state_ = std::move(other.state_);
+                                      return *this; }
+
+  bool isValid() const { return state_ != nullptr; }
+
+  bool isReady() const;
+  int wait();
+
+private:
+  std::shared_ptr<FutureState> state_;
+};
+
+void RunCores(int coreCount, Coroutine &&coroutine);
+int GetCoreCount();
+int GetCurrentCore();
+Future SubmitTo(int core, const Coroutine &coroutine);
+Future SubmitTo(int core, Coroutine &&coroutine);
+
+} // namespace Tara
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <utility>
+
+namespace Tara {
+
+void RetireSnapshotVersion(void *version, void (*deleter)(void *version));
+
+template<typename TYPE>
+class Snapshot final
+{
+  Snapshot(const Snapshot &other) = delete;
+  void operator=(const Snapshot &other) = delete;
+
+public:
+  Snapshot() : version_(nullptr) {}
+  explicit Snapshot(TYPE *version) : version_(version) {}
+  ~Snapshot() { delete version_; }
+
+  const TYPE *get() const { return __atomic_load_n(&version_,
+                                                   __ATOMIC_ACQUIRE); }
+
+  template<typename... ARGUMENTS>
+  void emplace(ARGUMENTS &&...arguments)
+  { publish(new TYPE(std::forward<ARGUMENTS>(arguments)...)); }
+
+  void publish(TYPE *version);
+
+private:
+  static void DeleteVersion(void *version) { delete static_cast<TYPE *>
+                                                    (version); }
+
+  TYPE *version_;
+};
+
+template<typename TYPE>
+void Snapshot<TYPE>::publish(TYPE *version)
+{
+  TYPE *oldVersion = __atomic_exchange_n(&version_, version,
+                                         __ATOMIC_ACQ_REL);
+  if (oldVersion != nullptr) {
+    RetireSnapshotVersion(oldVersion, DeleteVersion);
+  }
+}
+
+} // namespace Tara
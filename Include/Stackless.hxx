@@ -0,0 +1,190 @@
+#pragma once
+
+#ifndef __cpp_impl_coroutine
+#error Stackless.hxx requires C++20 coroutines
+#endif
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#
+#include <errno.h>
+#include <stddef.h>
+#
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <utility>
+
+namespace Tara {
+
+namespace Stackless {
+
+void *AllocateFrame(size_t size);
+void FreeFrame(void *frame, size_t size);
+void SuspendForYield(void *coroutineAddress, int *status);
+void SuspendForSleep(void *coroutineAddress, int *status, int duration);
+void SuspendForTask(void *coroutineAddress, int *status,
+                    const std::function<void ()> *task);
+
+class PromiseBase
+{
+public:
+  static void *operator new(size_t size) { return AllocateFrame(size); }
+  static void operator delete(void *frame, size_t size)
+  { FreeFrame(frame, size); }
+
+  std::suspend_always initial_suspend() const noexcept { return {}; }
+  void unhandled_exception() const noexcept { std::terminate(); }
+
+  auto final_suspend() const noexcept
+  {
+    struct FinalAwaitable final
+    {
+      bool await_ready() const noexcept { return false; }
+      void await_resume() const noexcept {}
+
+      std::coroutine_handle<>
+      await_suspend(std::coroutine_handle<>) const noexcept
+      { return continuation; }
+
+      std::coroutine_handle<> continuation;
+    };
+
+    return FinalAwaitable{continuation_ ? continuation_
+                                        : std::noop_coroutine()};
+  }
+
+  void setContinuation(std::coroutine_handle<> continuation)
+  { continuation_ = continuation; }
+
+private:
+  std::coroutine_handle<> continuation_;
+};
+
+template<typename TYPE>
+class Promise : public PromiseBase
+{
+public:
+  void return_value(TYPE value) { value_ = std::move(value); }
+  TYPE takeValue() { return std::move(value_); }
+
+private:
+  TYPE value_{};
+};
+
+template<>
+class Promise<void> : public PromiseBase
+{
+public:
+  void return_void() const noexcept {}
+  void takeValue() const noexcept {}
+};
+
+template<typename TYPE = void>
+class Task final
+{
+  Task(const Task &other) = delete;
+  void operator=(const Task &other) = delete;
+
+public:
+  class promise_type final : public Promise<TYPE>
+  {
+  public:
+    Task get_return_object()
+    { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+  };
+
+  Task(Task &&other) noexcept : coroutine_(std::exchange(other.coroutine_,
+                                                         nullptr)) {}
+  ~Task() { if (coroutine_) { coroutine_.destroy(); } }
+
+  auto operator co_await() && noexcept
+  {
+    struct Awaitable final
+    {
+      bool await_ready() const noexcept { return false; }
+      TYPE await_resume() const { return coroutine.promise().takeValue(); }
+
+      std::coroutine_handle<>
+      await_suspend(std::coroutine_handle<> continuation) const noexcept
+      { coroutine.promise().setContinuation(continuation);
+        return coroutine; }
+
+      std::coroutine_handle<promise_type> coroutine;
+    };
+
+    return Awaitable{coroutine_};
+  }
+
+private:
+  std::coroutine_handle<promise_type> coroutine_;
+
+  explicit Task(std::coroutine_handle<promise_type> coroutine)
+    : coroutine_(coroutine) {}
+};
+
+class Awaitable
+{
+public:
+  bool await_ready() const noexcept { return false; }
+
+  int await_resume() const noexcept
+  {
+    if (status_ < 0) {
+      errno = -status_;
+      return -1;
+    }
+    return 0;
+  }
+
+protected:
+  int status_ = 0;
+};
+
+class YieldAwaitable final : public Awaitable
+{
+public:
+  void await_suspend(std::coroutine_handle<> coroutine)
+  { SuspendForYield(coroutine.address(), &status_); }
+};
+
+class SleepAwaitable final : public Awaitable
+{
+public:
+  explicit SleepAwaitable(int duration) : duration_(duration) {}
+
+  void await_suspend(std::coroutine_handle<> coroutine)
+  { SuspendForSleep(coroutine.address(), &status_, duration_); }
+
+private:
+  const int duration_;
+};
+
+class TaskAwaitable final : public Awaitable
+{
+public:
+  explicit TaskAwaitable(std::function<void ()> &&task)
+    : task_(std::move(task)) {}
+
+  void await_suspend(std::coroutine_handle<> coroutine)
+  { SuspendForTask(coroutine.address(), &status_, &task_); }
+
+private:
+  const std::function<void ()> task_;
+};
+
+inline YieldAwaitable Yield() { return YieldAwaitable(); }
+inline SleepAwaitable Sleep(int duration) { return SleepAwaitable(duration); }
+
+inline TaskAwaitable AwaitTask(std::function<void ()> task)
+{ return TaskAwaitable(std::move(task)); }
+
+void Spawn(Task<> &&task);
+Task<ssize_t> Read(int fd, void *buf, size_t buflen, int timeout);
+Task<ssize_t> Write(int fd, const void *buf, size_t buflen, int timeout);
+Task<int> Accept4(int fd, sockaddr *addr, socklen_t *addrlen, int flags,
+                  int timeout);
+
+} // namespace Stackless
+
+} // namespace Tara
@@ -0,0 +1,115 @@
+#include "Arena.hxx"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#
+#include "Log.hxx"
+#include "MemoryPool.hxx"
+
+namespace Tara {
+
+struct alignas(max_align_t) ArenaPage final
+{
+  ArenaPage *prev;
+};
+
+struct alignas(max_align_t) ArenaLargeBlock final
+{
+  ArenaLargeBlock *prev;
+};
+
+namespace {
+
+uintptr_t AlignAddress(const void *address, size_t alignment);
+
+} // namespace
+
+FiberArena::FiberArena(MemoryPool *pagePool, size_t pageSize)
+  : pagePool_(pagePool), pageSize_(pageSize), lastPage_(nullptr),
+    lastLargeBlock_(nullptr), top_(nullptr), limit_(nullptr)
+{
+  assert(pagePool_ != nullptr);
+  assert(pageSize_ > sizeof(ArenaPage));
+}
+
+FiberArena::~FiberArena()
+{
+  reset();
+}
+
+void *FiberArena::allocate(size_t size, size_t alignment)
+{
+  assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+  if (size == 0) {
+    size = 1;
+  }
+  size_t pageCapacity = pageSize_ - sizeof(ArenaPage);
+  if (alignment >= pageCapacity || size > pageCapacity - alignment) {
+    return allocateLargeBlock(size, alignment);
+  }
+  uintptr_t address = AlignAddress(top_, alignment);
+  if (top_ == nullptr || address + size > reinterpret_cast<uintptr_t>(limit_)) {
+    increasePages();
+    address = AlignAddress(top_, alignment);
+  }
+  top_ = reinterpret_cast<unsigned char *>(address + size);
+  return reinterpret_cast<void *>(address);
+}
+
+void FiberArena::reset()
+{
+  ArenaLargeBlock *largeBlock = lastLargeBlock_;
+  while (largeBlock != nullptr) {
+    ArenaLargeBlock *largeBlockPrev = largeBlock->prev;
+    free(largeBlock);
+    largeBlock = largeBlockPrev;
+  }
+  lastLargeBlock_ = nullptr;
+  ArenaPage *page = lastPage_;
+  while (page != nullptr) {
+    ArenaPage *pagePrev = page->prev;
+    pagePool_->freeBlock(page);
+    page = pagePrev;
+  }
+  lastPage_ = nullptr;
+  top_ = nullptr;
+  limit_ = nullptr;
+}
+
+void *FiberArena::allocateLargeBlock(size_t size, size_t alignment)
+{
+  size_t padding = alignment > alignof(ArenaLargeBlock) ? alignment : 0;
+  if (size > SIZE_MAX - sizeof(ArenaLargeBlock) - padding) {
+    TARA_FATALITY_LOG("arena allocation too large: ", size);
+  }
+  auto largeBlock = static_cast<ArenaLargeBlock *>
+                    (malloc(sizeof(ArenaLargeBlock) + padding + size));
+  if (largeBlock == nullptr) {
+    TARA_FATALITY_LOG("malloc failed");
+  }
+  largeBlock->prev = lastLargeBlock_;
+  lastLargeBlock_ = largeBlock;
+  return reinterpret_cast<void *>(AlignAddress(largeBlock + 1, alignment));
+}
+
+void FiberArena::increasePages()
+{
+  auto page = static_cast<ArenaPage *>(pagePool_->allocateBlock());
+  page->prev = lastPage_;
+  lastPage_ = page;
+  top_ = reinterpret_cast<unsigned char *>(page + 1);
+  limit_ = reinterpret_cast<unsigned char *>(page) + pageSize_;
+}
+
+namespace {
+
+uintptr_t AlignAddress(const void *address, size_t alignment)
+{
+  return (reinterpret_cast<uintptr_t>(address) + alignment - 1) &
+         ~static_cast<uintptr_t>(alignment - 1);
+}
+
+} // namespace
+
+} // namespace Tara
@@ -7,26 +7,31 @@
 #include <errno.h>
 #include <stdint.h>
 #
+#include "Clock.hxx"
 #include "Error.hxx"
 #include "IOEvent.hxx"
 #include "Log.hxx"
+#include "Quiescence.hxx"
 #include "Scheduler.hxx"
 #include "Utility.hxx"
 
 namespace Tara {
 
-namespace {
-
-struct Job final
+struct AsyncJob final
 {
   QUEUE queueItem;
-  Fiber *const fiber;
+  Waiter *const waiter;
   const Task *const tasks;
   const unsigned int taskCount;
+  const uint64_t submitTime;
+  uint64_t startTime;
+  uint64_t finishTime;
 
-  Job(Fiber *fiber, const Task *tasks, unsigned int taskCount);
+  AsyncJob(Waiter *waiter, const Task *tasks, unsigned int taskCount);
 };
 
+namespace {
+
 int xeventfd(unsigned int initval, int flags);
 size_t xwrite(int fd, const void *buf, size_t nbytes);
 size_t xread(int fd, void *buf, size_t nbytes);
@@ -79,6 +84,7 @@ Async::~Async()
 
 void Async::doWork()
 {
+  RegisterQuiescentThread();
   for (;;) {
     xthread_mutex_lock(&mutexes_[0]);
     while (!workIsDone_ && QUEUE_EMPTY(&jobQueues_[0])) {
@@ -88,25 +94,31 @@ void Async::doWork()
       xthread_mutex_unlock(&mutexes_[0]);
       break;
     }
-    auto job = QUEUE_DATA(QUEUE_HEAD(&jobQueues_[0]), Job, queueItem);
+    auto job = QUEUE_DATA(QUEUE_HEAD(&jobQueues_[0]), AsyncJob, queueItem);
     QUEUE_REMOVE(&job->queueItem);
     xthread_mutex_unlock(&mutexes_[0]);
+    LeaveQuiescentState();
+    job->startTime = GetPreciseTime();
     for (int i = 0; i < job->taskCount; ++i) {
       job->tasks[i]();
     }
+    job->finishTime = GetPreciseTime();
+    EnterQuiescentState();
     xthread_mutex_lock(&mutexes_[1]);
     QUEUE_INSERT_TAIL(&jobQueues_[1], &job->queueItem);
     uint64_t value = 1;
     static_cast<void>(xwrite(fd_, &value, sizeof value));
     xthread_mutex_unlock(&mutexes_[1]);
   }
+  UnregisterQuiescentThread();
 }
 
-void Async::awaitTasks(const Task *tasks, unsigned int taskCount)
+void Async::submitTasks(Waiter *waiter, const Task *tasks,
+                        unsigned int taskCount)
 {
-  Job job(scheduler_->getCurrentFiber(), tasks, taskCount);
+  AsyncJob *job = jobPool_.createObject(waiter, tasks, taskCount);
   xthread_mutex_lock(&mutexes_[0]);
-  QUEUE_INSERT_TAIL(&jobQueues_[0], &job.queueItem);
+  QUEUE_INSERT_TAIL(&jobQueues_[0], &job->queueItem);
   xthread_cond_signal(&condition_);
   xthread_mutex_unlock(&mutexes_[0]);
   ++jobCount_;
@@ -122,27 +134,32 @@ void Async::awaitTasks(const Task *tasks, unsigned int taskCount)
         QUEUE *q = QUEUE_HEAD(&jobQueues_[1]);
         QUEUE_SPLIT(&jobQueues_[1], q, &jobQueue);
         xthread_mutex_unlock(&mutexes_[1]);
-        QUEUE_FOREACH(q, &jobQueue) {
-          auto job = QUEUE_DATA(q, Job, queueItem);
-          scheduler_->resumeFiber(job->fiber);
+        while (!QUEUE_EMPTY(&jobQueue)) {
+          auto job = QUEUE_DATA(QUEUE_HEAD(&jobQueue), AsyncJob, queueItem);
+          QUEUE_REMOVE(&job->queueItem);
+          queueWaitHistogram_.record((job->startTime - job->submitTime)
+                                     / 1000);
+          serviceHistogram_.record((job->finishTime - job->startTime) / 1000);
+          scheduler_->resumeWaiter(job->waiter);
+          jobPool_.destroyObject(job);
           --jobCount_;
         }
       } while (jobCount_ != 0);
       scheduler_->unwatchIO(fd_);
     });
   }
-  scheduler_->suspendCurrentFiber();
 }
 
-namespace {
-
-Job::Job(Fiber *fiber, const Task *tasks, unsigned int taskCount)
-  : fiber(fiber), tasks(tasks), taskCount(taskCount)
+AsyncJob::AsyncJob(Waiter *waiter, const Task *tasks, unsigned int taskCount)
+  : waiter(waiter), tasks(tasks), taskCount(taskCount),
+    submitTime(GetPreciseTime()), startTime(0), finishTime(0)
 {
-  assert(this->fiber != nullptr);
+  assert(this->waiter != nullptr);
   assert(this->taskCount == 0 || this->tasks != nullptr);
 }
 
+namespace {
+
 int xeventfd(unsigned int initval, int flags)
 {
   int fd = eventfd(initval, flags);
@@ -5,10 +5,15 @@
 #include <functional>
 #
 #include "libuv/queue.h"
+#
+#include "Histogram.hxx"
+#include "ObjectPool.hxx"
 
 namespace Tara {
 
 class Scheduler;
+struct AsyncJob;
+struct Waiter;
 
 typedef std::function<void ()> Task;
 
@@ -21,9 +26,12 @@ public:
   explicit Async(Scheduler *scheduler);
   ~Async();
 
-  void awaitTask(const Task *task) { awaitTasks(task, 1); }
+  unsigned int getJobCount() const { return jobCount_; }
+  const Histogram &getQueueWaitHistogram() const
+  { return queueWaitHistogram_; }
+  const Histogram &getServiceHistogram() const { return serviceHistogram_; }
 
-  void awaitTasks(const Task *tasks, unsigned int taskCount);
+  void submitTasks(Waiter *waiter, const Task *tasks, unsigned int taskCount);
 
 private:
   static void Worker(Async *async) { async->doWork(); }
@@ -36,6 +44,9 @@ private:
   pthread_mutex_t mutexes_[2];
   pthread_cond_t condition_;
   pthread_t threads_[4];
+  ObjectPool<AsyncJob, 64> jobPool_;
+  Histogram queueWaitHistogram_;
+  Histogram serviceHistogram_;
 
   void doWork();
 };
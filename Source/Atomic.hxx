@@ -2,41 +2,195 @@
 
 namespace Tara {
 
-#if defined __i386__ || defined __x86_64__
+enum class MemoryOrder
+{
+  Relaxed = __ATOMIC_RELAXED,
+  Acquire = __ATOMIC_ACQUIRE,
+  Release = __ATOMIC_RELEASE,
+  AcquireRelease = __ATOMIC_ACQ_REL,
+  SequentiallyConsistent = __ATOMIC_SEQ_CST
+};
 
 template<typename TYPE>
-inline void Exchange(TYPE &lvalue1, TYPE &lvalue2)
+inline TYPE Load(const TYPE &lvalue,
+                 MemoryOrder memoryOrder = MemoryOrder::SequentiallyConsistent)
 {
-  __asm__ __volatile__ ("lock xchg %1, %0" : "+m"(lvalue1), "+r"(lvalue2));
-  // lvalue1 <-> lvalue2
+  TYPE result;
+  __atomic_load(&lvalue, &result, static_cast<int>(memoryOrder));
+  return result;
 }
 
 template<typename TYPE>
-inline void ExchangeAdd(TYPE &lvalue1, TYPE &lvalue2)
+inline void Store(TYPE &lvalue, TYPE rvalue,
+                  MemoryOrder memoryOrder = MemoryOrder::SequentiallyConsistent)
 {
-  __asm__ __volatile__ ("lock xadd %1, %0" : "+m"(lvalue1), "+r"(lvalue2));
-  // lvalue1 <-> lvalue2
-  // lvalue1 <- lvalue1 + lvalue2
+  __atomic_store(&lvalue, &rvalue, static_cast<int>(memoryOrder));
 }
 
 template<typename TYPE>
-inline bool CompareExchange(TYPE &lvalue1, TYPE &lvalue2, const TYPE &rvalue3)
+inline TYPE Exchange(TYPE &lvalue, TYPE rvalue,
+                     MemoryOrder memoryOrder
+                     = MemoryOrder::SequentiallyConsistent)
+{
+  TYPE result;
+  __atomic_exchange(&lvalue, &rvalue, &result, static_cast<int>(memoryOrder));
+  return result;
+}
+
+template<typename TYPE>
+inline bool CompareExchange(TYPE &lvalue1, TYPE &lvalue2, TYPE rvalue3,
+                            MemoryOrder memoryOrder
+                            = MemoryOrder::SequentiallyConsistent)
 {
-  char result;
-  __asm__ __volatile__ ("lock cmpxchg %3, %0\n\t"
-                        "sete %2" : "+m"(lvalue1), "+a"(lvalue2), "=m"(result)
-                                  : "r"(rvalue3));
   // if lvalue1 = lvalue2
   //   lvalue1 <- rvalue3
-  //   result <- 1
+  //   return true
   // else
   //   lvalue2 <- lvalue1
-  //   result <- 0
-  return result != 0;
+  //   return false
+  int failureMemoryOrder;
+  switch (memoryOrder) {
+  case MemoryOrder::Release:
+    failureMemoryOrder = __ATOMIC_RELAXED;
+    break;
+  case MemoryOrder::AcquireRelease:
+    failureMemoryOrder = __ATOMIC_ACQUIRE;
+    break;
+  default:
+    failureMemoryOrder = static_cast<int>(memoryOrder);
+    break;
+  }
+  return __atomic_compare_exchange(&lvalue1, &lvalue2, &rvalue3, false,
+                                   static_cast<int>(memoryOrder),
+                                   failureMemoryOrder);
+}
+
+template<typename TYPE>
+inline TYPE FetchAdd(TYPE &lvalue, TYPE rvalue,
+                     MemoryOrder memoryOrder
+                     = MemoryOrder::SequentiallyConsistent)
+{
+  return __atomic_fetch_add(&lvalue, rvalue, static_cast<int>(memoryOrder));
+}
+
+template<typename TYPE>
+inline TYPE FetchSub(TYPE &lvalue, TYPE rvalue,
+                     MemoryOrder memoryOrder
+                     = MemoryOrder::SequentiallyConsistent)
+{
+  return __atomic_fetch_sub(&lvalue, rvalue, static_cast<int>(memoryOrder));
+}
+
+template<typename TYPE>
+inline TYPE FetchAnd(TYPE &lvalue, TYPE rvalue,
+                     MemoryOrder memoryOrder
+                     = MemoryOrder::SequentiallyConsistent)
+{
+  return __atomic_fetch_and(&lvalue, rvalue, static_cast<int>(memoryOrder));
+}
+
+template<typename TYPE>
+inline TYPE FetchOr(TYPE &lvalue, TYPE rvalue,
+                    MemoryOrder memoryOrder
+                    = MemoryOrder::SequentiallyConsistent)
+{
+  return __atomic_fetch_or(&lvalue, rvalue, static_cast<int>(memoryOrder));
+}
+
+inline void ThreadFence(MemoryOrder memoryOrder
+                        = MemoryOrder::SequentiallyConsistent)
+{
+  __atomic_thread_fence(static_cast<int>(memoryOrder));
+}
+
+inline void SignalFence(MemoryOrder memoryOrder
+                        = MemoryOrder::SequentiallyConsistent)
+{
+  __atomic_signal_fence(static_cast<int>(memoryOrder));
 }
 
+inline void CPURelax()
+{
+#if defined __i386__ || defined __x86_64__
+  __builtin_ia32_pause();
+#elif defined __aarch64__
+  __asm__ __volatile__ ("yield");
 #else
-#error architecture not supported
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
 #endif
+}
+
+class SpinLock final
+{
+  SpinLock(const SpinLock &other) = delete;
+  void operator=(const SpinLock &other) = delete;
+
+public:
+  SpinLock() : isLocked_(false) {}
+
+  bool tryLock() { return !Load(isLocked_, MemoryOrder::Relaxed) &&
+                          !Exchange(isLocked_, true, MemoryOrder::Acquire); }
+  void unlock() { Store(isLocked_, false, MemoryOrder::Release); }
+
+  void lock();
+
+private:
+  bool isLocked_;
+};
+
+class SeqLock final
+{
+  SeqLock(const SeqLock &other) = delete;
+  void operator=(const SeqLock &other) = delete;
+
+public:
+  SeqLock() : sequenceNumber_(0) {}
+
+  bool endRead(unsigned int sequenceNumber) const
+  { ThreadFence(MemoryOrder::Acquire);
+    return Load(sequenceNumber_, MemoryOrder::Relaxed) == sequenceNumber; }
+
+  unsigned int beginRead() const;
+  void beginWrite();
+  void endWrite();
+
+private:
+  unsigned int sequenceNumber_;
+};
+
+inline void SpinLock::lock()
+{
+  unsigned int pauseCount = 1;
+  while (!tryLock()) {
+    for (unsigned int i = 0; i < pauseCount; ++i) {
+      CPURelax();
+    }
+    if (pauseCount < 64) {
+      pauseCount *= 2;
+    }
+  }
+}
+
+inline unsigned int SeqLock::beginRead() const
+{
+  for (;;) {
+    unsigned int sequenceNumber = Load(sequenceNumber_, MemoryOrder::Acquire);
+    if ((sequenceNumber & 1) == 0) {
+      return sequenceNumber;
+    }
+    CPURelax();
+  }
+}
+
+inline void SeqLock::beginWrite()
+{
+  Store(sequenceNumber_, sequenceNumber_ + 1, MemoryOrder::Relaxed);
+  ThreadFence(MemoryOrder::Release);
+}
+
+inline void SeqLock::endWrite()
+{
+  Store(sequenceNumber_, sequenceNumber_ + 1, MemoryOrder::Release);
+}
 
 } // namespace Tara
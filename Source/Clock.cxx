@@ -0,0 +1,42 @@
+#include "Clock.hxx"
+
+#include <errno.h>
+#include <time.h>
+#
+#include "Error.hxx"
+#include "Log.hxx"
+
+namespace Tara {
+
+namespace {
+
+void xclock_gettime(clockid_t clock_id, timespec *tp);
+
+} // namespace
+
+uint64_t GetTime()
+{
+  timespec time;
+  xclock_gettime(CLOCK_MONOTONIC_COARSE, &time);
+  return time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+uint64_t GetPreciseTime()
+{
+  timespec time;
+  xclock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * UINT64_C(1000000000) + time.tv_nsec;
+}
+
+namespace {
+
+void xclock_gettime(clockid_t clock_id, timespec *tp)
+{
+  if (clock_gettime(clock_id, tp) < 0) {
+    TARA_FATALITY_LOG("clock_gettime failed: ", Error(errno));
+  }
+}
+
+} // namespace
+
+} // namespace Tara
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace Tara {
+
+uint64_t GetTime();
+uint64_t GetPreciseTime();
+
+} // namespace Tara
@@ -0,0 +1,50 @@
+#include "Embedding.hxx"
+
+#include "Log.hxx"
+#include "Scheduler.hxx"
+
+#define CHECK_THE_SCHEDULER              \
+  do {                                   \
+    if (TheScheduler == nullptr) {       \
+      TARA_FATALITY_LOG("No scheduler"); \
+    }                                    \
+  } while (false)
+
+namespace Tara {
+
+thread_local Scheduler *TheScheduler;
+
+void CreateScheduler()
+{
+  if (TheScheduler != nullptr) {
+    TARA_FATALITY_LOG("Scheduler already exists");
+  }
+  TheScheduler = new Scheduler;
+}
+
+void DestroyScheduler()
+{
+  CHECK_THE_SCHEDULER;
+  delete TheScheduler;
+  TheScheduler = nullptr;
+}
+
+bool RunOnce(int timeout)
+{
+  CHECK_THE_SCHEDULER;
+  return TheScheduler->runOnce(timeout);
+}
+
+int GetPollFD()
+{
+  CHECK_THE_SCHEDULER;
+  return TheScheduler->getPollFD();
+}
+
+int GetPollTimeout()
+{
+  CHECK_THE_SCHEDULER;
+  return TheScheduler->getPollTimeout();
+}
+
+} // namespace Tara
@@ -0,0 +1,79 @@
+#include "Histogram.hxx"
+
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
+
+namespace Tara {
+
+unsigned long long Histogram::GetBucketLowerBound(unsigned int bucketIndex)
+{
+  assert(bucketIndex < BucketCount);
+  if (bucketIndex < SubBucketCount) {
+    return bucketIndex;
+  }
+  unsigned int shift = bucketIndex / SubBucketCount - 1;
+  unsigned long long subBucket = bucketIndex % SubBucketCount
+                                 + SubBucketCount;
+  return subBucket << shift;
+}
+
+unsigned long long Histogram::GetBucketUpperBound(unsigned int bucketIndex)
+{
+  assert(bucketIndex < BucketCount);
+  if (bucketIndex == BucketCount - 1) {
+    return ULLONG_MAX;
+  }
+  return GetBucketLowerBound(bucketIndex + 1) - 1;
+}
+
+void Histogram::reset()
+{
+  count_ = 0;
+  sum_ = 0;
+  min_ = ULLONG_MAX;
+  max_ = 0;
+  for (unsigned int i = 0; i < BucketCount; ++i) {
+    counts_[i] = 0;
+  }
+}
+
+void Histogram::merge(const Histogram &other)
+{
+  count_ += other.count_;
+  sum_ += other.sum_;
+  if (other.min_ < min_) {
+    min_ = other.min_;
+  }
+  if (other.max_ > max_) {
+    max_ = other.max_;
+  }
+  for (unsigned int i = 0; i < BucketCount; ++i) {
+    counts_[i] += other.counts_[i];
+  }
+}
+
+unsigned long long Histogram::getPercentile(double percentile) const
+{
+  if (count_ == 0) {
+    return 0;
+  }
+  if (percentile <= 0.0) {
+    return min_;
+  }
+  unsigned long long rank = ceil(percentile / 100.0 * count_);
+  if (rank >= count_) {
+    return max_;
+  }
+  unsigned long long count = 0;
+  for (unsigned int i = 0; i < BucketCount; ++i) {
+    count += counts_[i];
+    if (count >= rank) {
+      unsigned long long value = GetBucketUpperBound(i);
+      return value < max_ ? value : max_;
+    }
+  }
+  return max_;
+}
+
+} // namespace Tara
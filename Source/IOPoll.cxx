@@ -17,11 +17,12 @@ struct IOWatcher final
 {
   QUEUE queueItem;
   const int fd;
+  const bool isDaemon;
   uint32_t eventFlags;
   uint32_t pendingEventFlags;
   QUEUE eventAwaiterQueues[2];
 
-  explicit IOWatcher(int fd);
+  IOWatcher(int fd, bool isDaemon);
 };
 
 namespace {
@@ -40,7 +41,8 @@ void xclose(int fd);
 } // namespace
 
 IOPoll::IOPoll()
-  : fd_(xepoll_create1(0)), watcherMemoryPool_(sizeof(IOWatcher), 1024)
+  : fd_(xepoll_create1(0)), eventAwaiterCount_(0), waitCount_(0),
+    eventCount_(0), controlCount_(0)
 {
   QUEUE_INIT(&dirtyWatcherQueue_);
 }
@@ -50,14 +52,34 @@ IOPoll::~IOPoll()
   xclose(fd_);
 }
 
-void IOPoll::createWatcher(int fd)
+bool IOPoll::eventAwaitersExist(int fd) const
+{
+  assert(watcherExists(fd));
+  const IOWatcher *watcher = watchers_[fd];
+  for (const QUEUE &eventAwaiterQueue : watcher->eventAwaiterQueues) {
+    if (!QUEUE_EMPTY(&eventAwaiterQueue)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void IOPoll::reserveWatchers(unsigned int watcherCount)
+{
+  if (watcherCount > watchers_.size()) {
+    watchers_.resize(NextPowerOfTwo(watcherCount), nullptr);
+  }
+  watcherPool_.reserveObjects(watcherCount);
+}
+
+void IOPoll::createWatcher(int fd, bool isDaemon)
 {
   assert(fd >= 0);
   if (fd >= watchers_.size()) {
     watchers_.resize(NextPowerOfTwo(fd + 1), nullptr);
   }
   assert(watchers_[fd] == nullptr);
-  auto watcher = new (watcherMemoryPool_.allocateBlock()) IOWatcher(fd);
+  IOWatcher *watcher = watcherPool_.createObject(fd, isDaemon);
   QUEUE_INIT(&watcher->queueItem);
   watchers_[fd] = watcher;
 }
@@ -72,9 +94,9 @@ void IOPoll::destroyWatcher(int fd)
   }
   if (watcher->eventFlags != 0) {
     xepoll_ctl(fd_, EPOLL_CTL_DEL, watcher->fd, nullptr);
+    ++controlCount_;
   }
-  watcher->~IOWatcher();
-  watcherMemoryPool_.freeBlock(watcher);
+  watcherPool_.destroyObject(watcher);
 }
 
 void IOPoll::addEventAwaiter(QUEUE *eventAwaiterQueueItem, int fd,
@@ -86,6 +108,9 @@ void IOPoll::addEventAwaiter(QUEUE *eventAwaiterQueueItem, int fd,
   QUEUE *eventAwaiterQueue = &watcher->eventAwaiterQueues
                                        [static_cast<int>(event)];
   QUEUE_INSERT_TAIL(eventAwaiterQueue, eventAwaiterQueueItem);
+  if (!watcher->isDaemon) {
+    ++eventAwaiterCount_;
+  }
   uint32_t eventFlag = IOEventFlags[static_cast<int>(event)];
   if ((watcher->pendingEventFlags & eventFlag) == 0) {
     watcher->pendingEventFlags |= eventFlag;
@@ -100,6 +125,9 @@ void IOPoll::removeEventAwaiter(const QUEUE &eventAwaiterQueueItem, int fd)
   assert(watcherExists(fd));
   IOWatcher *watcher = watchers_[fd];
   QUEUE_REMOVE(&eventAwaiterQueueItem);
+  if (!watcher->isDaemon) {
+    --eventAwaiterCount_;
+  }
   if (QUEUE_NEXT(&eventAwaiterQueueItem) ==
       QUEUE_PREV(&eventAwaiterQueueItem)) {
     uint32_t eventFlag = IOEventFlags[QUEUE_NEXT(&eventAwaiterQueueItem) -
@@ -119,6 +147,15 @@ void IOPoll::removeEventAwaiters(int fd, QUEUE *eventAwaiterQueue)
   if (watcher->pendingEventFlags == 0) {
     return;
   }
+  if (!watcher->isDaemon) {
+    QUEUE *q;
+    QUEUE_FOREACH(q, &watcher->eventAwaiterQueues[0]) {
+      --eventAwaiterCount_;
+    }
+    QUEUE_FOREACH(q, &watcher->eventAwaiterQueues[1]) {
+      --eventAwaiterCount_;
+    }
+  }
   if (!QUEUE_EMPTY(&watcher->eventAwaiterQueues[0])) {
     QUEUE_ADD(eventAwaiterQueue, &watcher->eventAwaiterQueues[0]);
     QUEUE_INIT(&watcher->eventAwaiterQueues[0]);
@@ -133,36 +170,43 @@ void IOPoll::removeEventAwaiters(int fd, QUEUE *eventAwaiterQueue)
   }
 }
 
-bool IOPoll::waitForEvents(int timeout, QUEUE *eventAwaiterQueue)
+void IOPoll::flushWatchers()
 {
-  assert(eventAwaiterQueue != nullptr);
-  if (!QUEUE_EMPTY(&dirtyWatcherQueue_)) {
-    QUEUE *q = QUEUE_HEAD(&dirtyWatcherQueue_);
-    do {
-      auto watcher = QUEUE_DATA(q, IOWatcher, queueItem);
-      q = QUEUE_NEXT(q);
-      QUEUE_INIT(&watcher->queueItem);
-      if (watcher->eventFlags == watcher->pendingEventFlags) {
-        continue;
-      }
-      int op;
-      if (watcher->eventFlags == 0) {
-        op = EPOLL_CTL_ADD;
+  if (QUEUE_EMPTY(&dirtyWatcherQueue_)) {
+    return;
+  }
+  QUEUE *q = QUEUE_HEAD(&dirtyWatcherQueue_);
+  do {
+    auto watcher = QUEUE_DATA(q, IOWatcher, queueItem);
+    q = QUEUE_NEXT(q);
+    QUEUE_INIT(&watcher->queueItem);
+    if (watcher->eventFlags == watcher->pendingEventFlags) {
+      continue;
+    }
+    int op;
+    if (watcher->eventFlags == 0) {
+      op = EPOLL_CTL_ADD;
+    } else {
+      if (watcher->pendingEventFlags == 0) {
+        op = EPOLL_CTL_DEL;
       } else {
-        if (watcher->pendingEventFlags == 0) {
-          op = EPOLL_CTL_DEL;
-        } else {
-          op = EPOLL_CTL_MOD;
-        }
+        op = EPOLL_CTL_MOD;
       }
-      epoll_event event;
-      event.events = watcher->pendingEventFlags;
-      event.data.ptr = watcher;
-      xepoll_ctl(fd_, op, watcher->fd, &event);
-      watcher->eventFlags = watcher->pendingEventFlags;
-    } while (q != &dirtyWatcherQueue_);
-    QUEUE_INIT(&dirtyWatcherQueue_);
-  }
+    }
+    epoll_event event;
+    event.events = watcher->pendingEventFlags;
+    event.data.ptr = watcher;
+    xepoll_ctl(fd_, op, watcher->fd, &event);
+    ++controlCount_;
+    watcher->eventFlags = watcher->pendingEventFlags;
+  } while (q != &dirtyWatcherQueue_);
+  QUEUE_INIT(&dirtyWatcherQueue_);
+}
+
+bool IOPoll::waitForEvents(int timeout, QUEUE *eventAwaiterQueue)
+{
+  assert(eventAwaiterQueue != nullptr);
+  flushWatchers();
   epoll_event events[1024];
   int n = epoll_wait(fd_, events, TARA_LENGTH_OF(events), timeout);
   if (n < 0) {
@@ -171,6 +215,8 @@ bool IOPoll::waitForEvents(int timeout, QUEUE *eventAwaiterQueue)
     }
     TARA_FATALITY_LOG("epoll_wait failed: ", Error(errno));
   }
+  ++waitCount_;
+  eventCount_ += n;
   for (int i = 0; i < n; ++i) {
     const epoll_event &event = events[i];
     auto watcher = static_cast<IOWatcher *>(event.data.ptr);
@@ -192,8 +238,8 @@ bool IOPoll::waitForEvents(int timeout, QUEUE *eventAwaiterQueue)
   return true;
 }
 
-IOWatcher::IOWatcher(int fd)
-  : fd(fd), eventFlags(0), pendingEventFlags(0)
+IOWatcher::IOWatcher(int fd, bool isDaemon)
+  : fd(fd), isDaemon(isDaemon), eventFlags(0), pendingEventFlags(0)
 {
   QUEUE_INIT(&this->eventAwaiterQueues[0]);
   QUEUE_INIT(&this->eventAwaiterQueues[1]);
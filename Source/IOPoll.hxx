@@ -4,7 +4,7 @@
 #
 #include "libuv/queue.h"
 #
-#include "MemoryPool.hxx"
+#include "ObjectPool.hxx"
 
 namespace Tara {
 
@@ -20,21 +20,34 @@ public:
   IOPoll();
   ~IOPoll();
 
+  int getFD() const { return fd_; }
+  unsigned int getEventAwaiterCount() const { return eventAwaiterCount_; }
+  unsigned long getWaitCount() const { return waitCount_; }
+  unsigned long getEventCount() const { return eventCount_; }
+  unsigned long getControlCount() const { return controlCount_; }
+
   bool watcherExists(int fd) const
   { return fd >= 0 && fd < watchers_.size() && watchers_[fd] != nullptr; }
+  bool eventAwaitersExist(int fd) const;
 
-  void createWatcher(int fd);
+  void reserveWatchers(unsigned int watcherCount);
+  void createWatcher(int fd, bool isDaemon = false);
   void destroyWatcher(int fd);
   void addEventAwaiter(QUEUE *eventAwaiterQueueItem, int fd, IOEvent event);
   void removeEventAwaiter(const QUEUE &eventAwaiterQueueItem, int fd);
   void removeEventAwaiters(int fd, QUEUE *eventAwaiterQueue);
+  void flushWatchers();
   bool waitForEvents(int timeout, QUEUE *eventAwaiterQueue);
 
 private:
   const int fd_;
-  MemoryPool watcherMemoryPool_;
+  ObjectPool<IOWatcher, 1024> watcherPool_;
   std::vector<IOWatcher *> watchers_;
   QUEUE dirtyWatcherQueue_;
+  unsigned int eventAwaiterCount_;
+  unsigned long waitCount_;
+  unsigned long eventCount_;
+  unsigned long controlCount_;
 };
 
 } // namespace Tara
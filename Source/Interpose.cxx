@@ -0,0 +1,405 @@
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#
+#include <errno.h>
+#include <limits.h>
+#
+#include <vector>
+#
+#include "Atomic.hxx"
+#include "IOEvent.hxx"
+#include "Log.hxx"
+#include "Scheduler.hxx"
+
+#define TARA_INTERPOSE_FD_COUNT 65536
+
+namespace Tara {
+
+extern thread_local Scheduler *const TheScheduler;
+
+} // namespace Tara
+
+namespace {
+
+enum class FDKind : unsigned char
+{
+  Unknown,
+  Socket,
+  Other,
+};
+
+FDKind FDKinds[TARA_INTERPOSE_FD_COUNT];
+thread_local std::vector<bool> TemporarilyWatchedFDs;
+
+template<typename FUNCTION>
+FUNCTION LoadFunction(const char *name);
+
+bool FiberIsRunning();
+FDKind GetFDKind(int fd);
+void ForgetFD(int fd);
+bool AdoptFD(int fd);
+bool FDIsWatchedTemporarily(int fd);
+bool FDIsNonBlocking(int fd);
+int AwaitFD(int fd, Tara::IOEvent ioEvent, int timeout);
+int CreatePollSet(const pollfd *fds, nfds_t nfds);
+int ClampDuration(unsigned long long duration);
+
+} // namespace
+
+extern "C" ssize_t read(int fd, void *buf, size_t buflen)
+{
+  static auto realRead = LoadFunction<decltype(&read)>("read");
+  if (!AdoptFD(fd)) {
+    return realRead(fd, buf, buflen);
+  }
+  Tara::Scheduler *scheduler = Tara::TheScheduler;
+  scheduler->checkpoint();
+  ssize_t n;
+  for (;;) {
+    n = recv(fd, buf, buflen, MSG_DONTWAIT);
+    if (n >= 0) {
+      break;
+    }
+    if (errno == ENOTSOCK) {
+      ForgetFD(fd);
+      return realRead(fd, buf, buflen);
+    }
+    if (errno == EWOULDBLOCK) {
+      if (FDIsNonBlocking(fd)
+          || AwaitFD(fd, Tara::IOEvent::Readability, -1) < 0) {
+        break;
+      }
+      continue;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    break;
+  }
+  if (n < 0) {
+    return -1;
+  }
+  scheduler->chargeIO(Tara::IOEvent::Readability, n);
+  return n;
+}
+
+extern "C" ssize_t write(int fd, const void *buf, size_t buflen)
+{
+  static auto realWrite = LoadFunction<decltype(&write)>("write");
+  if (!AdoptFD(fd)) {
+    return realWrite(fd, buf, buflen);
+  }
+  Tara::Scheduler *scheduler = Tara::TheScheduler;
+  scheduler->checkpoint();
+  size_t m = 0;
+  while (m < buflen) {
+    ssize_t n = send(fd, static_cast<const char *>(buf) + m, buflen - m,
+                     MSG_DONTWAIT);
+    if (n >= 0) {
+      m += n;
+      continue;
+    }
+    if (errno == ENOTSOCK && m == 0) {
+      ForgetFD(fd);
+      return realWrite(fd, buf, buflen);
+    }
+    if (errno == EWOULDBLOCK) {
+      if (FDIsNonBlocking(fd)
+          || AwaitFD(fd, Tara::IOEvent::Writability, -1) < 0) {
+        break;
+      }
+      continue;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    break;
+  }
+  if (m == 0 && buflen != 0) {
+    return -1;
+  }
+  scheduler->chargeIO(Tara::IOEvent::Writability, m);
+  return m;
+}
+
+extern "C" int connect(int fd, const sockaddr *addr, socklen_t addrlen)
+{
+  static auto realConnect = LoadFunction<decltype(&connect)>("connect");
+  if (!AdoptFD(fd)) {
+    return realConnect(fd, addr, addrlen);
+  }
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || (flags & O_NONBLOCK) != 0) {
+    return realConnect(fd, addr, addrlen);
+  }
+  Tara::TheScheduler->checkpoint();
+  if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    return -1;
+  }
+  int result = realConnect(fd, addr, addrlen);
+  int errorNumber = errno;
+  static_cast<void>(fcntl(fd, F_SETFL, flags));
+  if (result >= 0) {
+    return 0;
+  }
+  if (errorNumber == EAGAIN) {
+    return realConnect(fd, addr, addrlen);
+  }
+  if (errorNumber != EINPROGRESS) {
+    errno = errorNumber;
+    return -1;
+  }
+  if (AwaitFD(fd, Tara::IOEvent::Writability, -1) < 0) {
+    return -1;
+  }
+  int optval;
+  socklen_t optlen = sizeof optval;
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0) {
+    return -1;
+  }
+  if (optval != 0) {
+    errno = optval;
+    return -1;
+  }
+  return 0;
+}
+
+extern "C" int poll(pollfd *fds, nfds_t nfds, int timeout)
+{
+  static auto realPoll = LoadFunction<decltype(&poll)>("poll");
+  if (!FiberIsRunning()) {
+    return realPoll(fds, nfds, timeout);
+  }
+  Tara::Scheduler *scheduler = Tara::TheScheduler;
+  scheduler->checkpoint();
+  if (nfds == 0) {
+    scheduler->sleepCurrentFiber(timeout);
+    return 0;
+  }
+  int n = realPoll(fds, nfds, 0);
+  if (n != 0 || timeout == 0) {
+    return n;
+  }
+  int fd;
+  Tara::IOEvent ioEvent;
+  int pollSetFD = -1;
+  if (nfds == 1 && GetFDKind(fds[0].fd) == FDKind::Socket
+      && (fds[0].events & (POLLIN | POLLOUT)) != (POLLIN | POLLOUT)
+      && (fds[0].events & (POLLIN | POLLOUT)) != 0) {
+    fd = fds[0].fd;
+    ioEvent = (fds[0].events & POLLIN) != 0 ? Tara::IOEvent::Readability
+                                            : Tara::IOEvent::Writability;
+  } else {
+    pollSetFD = CreatePollSet(fds, nfds);
+    if (pollSetFD < 0) {
+      return -1;
+    }
+    fd = pollSetFD;
+    ioEvent = Tara::IOEvent::Readability;
+  }
+  uint64_t deadline = timeout < 0 ? UINT64_MAX
+                                  : scheduler->getTime() + timeout;
+  for (;;) {
+    timeout = scheduler->calculateTimeout(deadline);
+    if (timeout == 0) {
+      n = 0;
+      break;
+    }
+    if (AwaitFD(fd, ioEvent, timeout) < 0) {
+      n = errno == ETIME ? 0 : -1;
+      break;
+    }
+    n = realPoll(fds, nfds, 0);
+    if (n != 0) {
+      break;
+    }
+  }
+  if (pollSetFD >= 0) {
+    int errorNumber = errno;
+    close(pollSetFD);
+    errno = errorNumber;
+  }
+  return n;
+}
+
+extern "C" unsigned int sleep(unsigned int seconds)
+{
+  static auto realSleep = LoadFunction<decltype(&sleep)>("sleep");
+  if (!FiberIsRunning()) {
+    return realSleep(seconds);
+  }
+  Tara::TheScheduler->sleepCurrentFiber(ClampDuration(seconds * 1000ULL));
+  return 0;
+}
+
+extern "C" int usleep(useconds_t usec)
+{
+  static auto realUsleep = LoadFunction<decltype(&usleep)>("usleep");
+  if (!FiberIsRunning()) {
+    return realUsleep(usec);
+  }
+  int duration = ClampDuration((usec + 999ULL) / 1000);
+  Tara::TheScheduler->sleepCurrentFiber(duration);
+  return 0;
+}
+
+extern "C" int nanosleep(const timespec *req, timespec *rem)
+{
+  static auto realNanosleep = LoadFunction<decltype(&nanosleep)>
+                              ("nanosleep");
+  if (!FiberIsRunning()) {
+    return realNanosleep(req, rem);
+  }
+  if (req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= 1000000000) {
+    errno = EINVAL;
+    return -1;
+  }
+  int duration = ClampDuration(req->tv_sec * 1000ULL +
+                               (req->tv_nsec + 999999) / 1000000);
+  Tara::TheScheduler->sleepCurrentFiber(duration);
+  if (rem != nullptr) {
+    rem->tv_sec = 0;
+    rem->tv_nsec = 0;
+  }
+  return 0;
+}
+
+extern "C" int close(int fd)
+{
+  static auto realClose = LoadFunction<decltype(&close)>("close");
+  ForgetFD(fd);
+  if (FDIsWatchedTemporarily(fd)) {
+    TemporarilyWatchedFDs[fd] = false;
+    Tara::Scheduler *scheduler = Tara::TheScheduler;
+    if (scheduler != nullptr && scheduler->ioIsWatched(fd)) {
+      scheduler->unwatchIO(fd);
+    }
+  }
+  return realClose(fd);
+}
+
+namespace {
+
+template<typename FUNCTION>
+FUNCTION LoadFunction(const char *name)
+{
+  void *function = dlsym(RTLD_NEXT, name);
+  if (function == nullptr) {
+    TARA_FATALITY_LOG("dlsym failed: ", name);
+  }
+  return reinterpret_cast<FUNCTION>(function);
+}
+
+bool FiberIsRunning()
+{
+  return Tara::TheScheduler != nullptr &&
+         Tara::TheScheduler->fiberIsRunning();
+}
+
+FDKind GetFDKind(int fd)
+{
+  if (fd <= STDERR_FILENO || fd >= TARA_INTERPOSE_FD_COUNT) {
+    return FDKind::Other;
+  }
+  FDKind fdKind = Tara::Load(FDKinds[fd], Tara::MemoryOrder::Relaxed);
+  if (fdKind == FDKind::Unknown) {
+    struct stat stat;
+    if (fstat(fd, &stat) < 0) {
+      return FDKind::Other;
+    }
+    fdKind = S_ISSOCK(stat.st_mode) ? FDKind::Socket : FDKind::Other;
+    Tara::Store(FDKinds[fd], fdKind, Tara::MemoryOrder::Relaxed);
+  }
+  return fdKind;
+}
+
+void ForgetFD(int fd)
+{
+  if (fd > STDERR_FILENO && fd < TARA_INTERPOSE_FD_COUNT) {
+    Tara::Store(FDKinds[fd], FDKind::Unknown, Tara::MemoryOrder::Relaxed);
+  }
+}
+
+bool AdoptFD(int fd)
+{
+  if (!FiberIsRunning() || GetFDKind(fd) != FDKind::Socket) {
+    return false;
+  }
+  return !Tara::TheScheduler->ioIsWatched(fd) || FDIsWatchedTemporarily(fd);
+}
+
+bool FDIsWatchedTemporarily(int fd)
+{
+  return fd >= 0 && fd < TemporarilyWatchedFDs.size()
+         && TemporarilyWatchedFDs[fd];
+}
+
+bool FDIsNonBlocking(int fd)
+{
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0) {
+    return true;
+  }
+  if ((flags & O_NONBLOCK) != 0) {
+    errno = EWOULDBLOCK;
+    return true;
+  }
+  return false;
+}
+
+int AwaitFD(int fd, Tara::IOEvent ioEvent, int timeout)
+{
+  Tara::Scheduler *scheduler = Tara::TheScheduler;
+  if (!scheduler->ioIsWatched(fd)) {
+    if (fd >= TemporarilyWatchedFDs.size()) {
+      TemporarilyWatchedFDs.resize(fd + 1, false);
+    }
+    TemporarilyWatchedFDs[fd] = true;
+    scheduler->watchIO(fd);
+  }
+  int result = scheduler->awaitIOEvent(fd, ioEvent, timeout);
+  if (FDIsWatchedTemporarily(fd) && !scheduler->ioIsAwaited(fd)) {
+    int errorNumber = errno;
+    TemporarilyWatchedFDs[fd] = false;
+    scheduler->unwatchIO(fd);
+    errno = errorNumber;
+  }
+  return result;
+}
+
+int CreatePollSet(const pollfd *fds, nfds_t nfds)
+{
+  int pollSetFD = epoll_create1(EPOLL_CLOEXEC);
+  if (pollSetFD < 0) {
+    return -1;
+  }
+  for (nfds_t i = 0; i < nfds; ++i) {
+    if (fds[i].fd < 0) {
+      continue;
+    }
+    epoll_event event;
+    event.events = 0;
+    event.data.fd = fds[i].fd;
+    for (nfds_t j = i; j < nfds; ++j) {
+      if (fds[j].fd == fds[i].fd) {
+        event.events |= fds[j].events & (POLLIN | POLLPRI | POLLOUT);
+      }
+    }
+    static_cast<void>(epoll_ctl(pollSetFD, EPOLL_CTL_ADD, fds[i].fd,
+                                &event));
+  }
+  return pollSetFD;
+}
+
+int ClampDuration(unsigned long long duration)
+{
+  return duration > INT_MAX ? INT_MAX : duration;
+}
+
+} // namespace
@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #
 #include <sstream>
+#
+#include "Atomic.hxx"
 
 #define TARA_LOG(LEVEL, ...)                                              \
   do {                                                                    \
@@ -50,8 +52,9 @@ public:
     Fatality
   };
 
-  static Level GetLevel();
-  static void SetLevel(Level level);
+  static Level GetLevel() { return Load(Level_, MemoryOrder::Relaxed); }
+  static void SetLevel(Level level)
+  { Store(Level_, level, MemoryOrder::Relaxed); }
 
   Log();
   ~Log();
@@ -1,21 +1,97 @@
-#include "Scheduler.hxx"
+#include <sched.h>
+#
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#
+#include <vector>
+#
+#include "Log.hxx"
+#include "Runtime.hxx"
+#include "Shard.hxx"
 
-namespace Tara {
+int TaraMain(int argc, char **argv);
 
-thread_local Scheduler *TheScheduler;
+namespace {
 
-} // namespace Tara
+int ReadCoreCount();
+unsigned int ReadNumber(const char *name);
+void PrewarmCores();
+void EnableWatchdog();
 
-int TaraMain(int argc, char **argv);
+} // namespace
 
 int main(int argc, char **argv)
 {
   int status = 0;
-  Tara::Scheduler scheduler;
-  Tara::TheScheduler = &scheduler;
-  scheduler.callCoroutine([argc, argv, &status] () {
+  EnableWatchdog();
+  Tara::RunCores(ReadCoreCount(), [argc, argv, &status] () {
+    PrewarmCores();
     status = TaraMain(argc, argv);
   });
-  scheduler.run();
+  Tara::StopWatchdog();
   return status;
 }
+
+namespace {
+
+int ReadCoreCount()
+{
+  const char *value = getenv("TARA_CORE_COUNT");
+  if (value == nullptr || *value == '\0') {
+    return 1;
+  }
+  char *end;
+  errno = 0;
+  long coreCount = strtol(value, &end, 10);
+  if (errno != 0 || *end != '\0' || coreCount < 0 || coreCount > CPU_SETSIZE) {
+    TARA_FATALITY_LOG("invalid TARA_CORE_COUNT: ", value);
+  }
+  return coreCount;
+}
+
+unsigned int ReadNumber(const char *name)
+{
+  const char *value = getenv(name);
+  if (value == nullptr || *value == '\0') {
+    return 0;
+  }
+  char *end;
+  errno = 0;
+  long count = strtol(value, &end, 10);
+  if (errno != 0 || *end != '\0' || count < 0 || count > INT_MAX) {
+    TARA_FATALITY_LOG("invalid ", name, ": ", value);
+  }
+  return count;
+}
+
+void PrewarmCores()
+{
+  unsigned int fiberCount = ReadNumber("TARA_PREWARM_FIBER_COUNT");
+  unsigned int fdCount = ReadNumber("TARA_PREWARM_FD_COUNT");
+  if (fiberCount == 0 && fdCount == 0) {
+    return;
+  }
+  std::vector<Tara::Future> futures;
+  for (int core = 0; core < Tara::GetCoreCount(); ++core) {
+    if (core != Tara::GetCurrentCore()) {
+      futures.push_back(Tara::SubmitTo(core, [fiberCount, fdCount] () {
+        Tara::Prewarm(fiberCount, fdCount);
+      }));
+    }
+  }
+  Tara::Prewarm(fiberCount, fdCount);
+  for (Tara::Future &future : futures) {
+    future.wait();
+  }
+}
+
+void EnableWatchdog()
+{
+  unsigned int threshold = ReadNumber("TARA_WATCHDOG_THRESHOLD");
+  if (threshold != 0) {
+    Tara::StartWatchdog(threshold);
+  }
+}
+
+} // namespace
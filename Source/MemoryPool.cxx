@@ -69,8 +69,17 @@ void MemoryPool::freeBlock(void *opaqueBlock)
   lastBlock_ = block;
 }
 
+void MemoryPool::reserveBlocks(unsigned int blockCount)
+{
+  size_t chunkLength = chunkSize_ / blockSize_;
+  while (chunkCount_ * chunkLength < blockCount) {
+    increaseBlocks();
+  }
+}
+
 void MemoryPool::increaseBlocks()
 {
+  MemoryBlock *lastBlock = lastBlock_;
   increaseChunks();
   MemoryChunk *chunk = chunkVector_[chunkCount_ - 1];
   auto block = TARA_CONTAINER_OF(chunk->base + chunkSize_ - blockSize_,
@@ -85,7 +94,7 @@ void MemoryPool::increaseBlocks()
     block->prev = blockPrev;
     block = blockPrev;
   }
-  block->prev = nullptr;
+  block->prev = lastBlock;
 }
 
 void MemoryPool::increaseChunks()
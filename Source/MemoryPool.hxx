@@ -18,6 +18,7 @@ public:
 
   void *allocateBlock();
   void freeBlock(void *opaqueBlock);
+  void reserveBlocks(unsigned int blockCount);
 
 private:
   const size_t blockSize_;
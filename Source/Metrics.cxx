@@ -0,0 +1,307 @@
+#include "Metrics.hxx"
+
+#include <sys/socket.h>
+#include <unistd.h>
+#
+#include <errno.h>
+#
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#
+#include "Error.hxx"
+#include "Log.hxx"
+#include "Runtime.hxx"
+#include "Scheduler.hxx"
+#include "Shard.hxx"
+
+#define TARA_METRICS_REQUEST_TIMEOUT 1000
+#define TARA_METRICS_ACCEPT_BACKOFF 100
+
+#define CHECK_THE_SCHEDULER              \
+  do {                                   \
+    if (TheScheduler == nullptr) {       \
+      TARA_FATALITY_LOG("No scheduler"); \
+    }                                    \
+  } while (false)
+
+namespace Tara {
+
+extern thread_local Scheduler *const TheScheduler;
+
+namespace {
+
+struct MetricDescriptor final
+{
+  const char *name;
+  const char *type;
+  const char *help;
+  unsigned long long SchedulerMetrics::*field;
+};
+
+const MetricDescriptor MetricDescriptors[] = {
+  {"tara_dispatches_total", "counter", "Fiber dispatches.",
+   &SchedulerMetrics::dispatchCount},
+  {"tara_fibers", "gauge", "Live fibers.", &SchedulerMetrics::fiberCount},
+  {"tara_cached_fibers", "gauge", "Dead fibers kept for reuse.",
+   &SchedulerMetrics::cachedFiberCount},
+  {"tara_ready_fibers", "gauge", "Fibers waiting to be dispatched.",
+   &SchedulerMetrics::readyFiberCount},
+  {"tara_fibers_created_total", "counter", "Fibers created.",
+   &SchedulerMetrics::createdFiberCount},
+  {"tara_fibers_recycled_total", "counter", "Fibers reused from the cache.",
+   &SchedulerMetrics::recycledFiberCount},
+  {"tara_fibers_destroyed_total", "counter", "Fibers destroyed.",
+   &SchedulerMetrics::destroyedFiberCount},
+  {"tara_polls_total", "counter", "I/O poll calls.",
+   &SchedulerMetrics::pollCount},
+  {"tara_poll_events_total", "counter", "I/O events returned by polls.",
+   &SchedulerMetrics::pollEventCount},
+  {"tara_poll_controls_total", "counter", "I/O poll registration changes.",
+   &SchedulerMetrics::pollControlCount},
+  {"tara_timers", "gauge", "Pending timers.", &SchedulerMetrics::timerCount},
+  {"tara_async_jobs", "gauge", "Blocking jobs in flight.",
+   &SchedulerMetrics::asyncJobCount},
+  {"tara_ready_lag_microseconds", "gauge",
+   "Moving average of ready queue latency.", &SchedulerMetrics::readyLag},
+};
+
+struct HistogramDescriptor final
+{
+  const char *name;
+  const char *labels;
+  const char *help;
+  Histogram SchedulerHistograms::*field;
+};
+
+const HistogramDescriptor HistogramDescriptors[] = {
+  {"tara_io_wait_microseconds", "event=\"readability\",",
+   "Time fibers spend awaiting I/O events.",
+   &SchedulerHistograms::readabilityWait},
+  {"tara_io_wait_microseconds", "event=\"writability\",", nullptr,
+   &SchedulerHistograms::writabilityWait},
+  {"tara_run_slice_microseconds", "", "Time between fiber switches.",
+   &SchedulerHistograms::runSlice},
+  {"tara_dispatch_delay_microseconds", "",
+   "Time from fiber readiness to dispatch.",
+   &SchedulerHistograms::dispatchDelay},
+  {"tara_async_queue_wait_microseconds", "",
+   "Time blocking jobs wait for a worker.",
+   &SchedulerHistograms::asyncQueueWait},
+  {"tara_async_service_microseconds", "",
+   "Time workers spend running blocking jobs.",
+   &SchedulerHistograms::asyncService},
+};
+
+const double Quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+thread_local std::vector<int> MetricsFDs;
+
+void CollectMetrics(std::vector<SchedulerMetrics> *metricsList,
+                    SchedulerHistograms *histograms);
+std::string FormatMetrics(const std::vector<SchedulerMetrics> &metricsList,
+                          const SchedulerHistograms &histograms);
+void HandleMetricsRequest(int fd);
+void AcceptMetricsRequests(int fd);
+
+} // namespace
+
+int GetSchedulerMetrics(SchedulerMetrics *metrics)
+{
+  CHECK_THE_SCHEDULER;
+  if (metrics == nullptr) {
+    errno = EINVAL;
+    return -1;
+  }
+  TheScheduler->getMetrics(metrics);
+  return 0;
+}
+
+int GetSchedulerHistograms(SchedulerHistograms *histograms)
+{
+  CHECK_THE_SCHEDULER;
+  if (histograms == nullptr) {
+    errno = EINVAL;
+    return -1;
+  }
+  TheScheduler->getHistograms(histograms);
+  return 0;
+}
+
+void SchedulerHistograms::merge(const SchedulerHistograms &other)
+{
+  readabilityWait.merge(other.readabilityWait);
+  writabilityWait.merge(other.writabilityWait);
+  runSlice.merge(other.runSlice);
+  dispatchDelay.merge(other.dispatchDelay);
+  asyncQueueWait.merge(other.asyncQueueWait);
+  asyncService.merge(other.asyncService);
+}
+
+int ServeMetrics(const sockaddr *addr, socklen_t addrlen)
+{
+  CHECK_THE_SCHEDULER;
+  if (addr == nullptr) {
+    errno = EINVAL;
+    return -1;
+  }
+  int fd = socket(addr->sa_family, SOCK_STREAM | SOCK_NONBLOCK
+                                   | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  int optval = 1;
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof optval) < 0
+      || bind(fd, addr, addrlen) < 0 || listen(fd, SOMAXCONN) < 0) {
+    int errorNumber = errno;
+    close(fd);
+    errno = errorNumber;
+    return -1;
+  }
+  TheScheduler->watchIO(fd, true);
+  Call([fd] () -> void {
+    AcceptMetricsRequests(fd);
+  }, StackSize::Small);
+  MetricsFDs.push_back(fd);
+  return fd;
+}
+
+int StopMetrics(int fd)
+{
+  CHECK_THE_SCHEDULER;
+  if (std::find(MetricsFDs.begin(), MetricsFDs.end(), fd)
+      == MetricsFDs.end()) {
+    errno = EBADF;
+    return -1;
+  }
+  return Close(fd);
+}
+
+namespace {
+
+void CollectMetrics(std::vector<SchedulerMetrics> *metricsList,
+                    SchedulerHistograms *histograms)
+{
+  int currentCore = GetCurrentCore();
+  if (currentCore < 0) {
+    metricsList->resize(1);
+    TheScheduler->getMetrics(&metricsList->front());
+    TheScheduler->getHistograms(histograms);
+    return;
+  }
+  metricsList->resize(GetCoreCount());
+  std::vector<std::unique_ptr<SchedulerHistograms>> histogramsList;
+  std::vector<Future> futures;
+  for (int core = 0; core < metricsList->size(); ++core) {
+    SchedulerMetrics *metrics = &(*metricsList)[core];
+    histogramsList.emplace_back(new SchedulerHistograms);
+    SchedulerHistograms *coreHistograms = histogramsList.back().get();
+    if (core == currentCore) {
+      TheScheduler->getMetrics(metrics);
+      TheScheduler->getHistograms(coreHistograms);
+      continue;
+    }
+    futures.push_back(SubmitTo(core, [metrics, coreHistograms] () -> void {
+      TheScheduler->getMetrics(metrics);
+      TheScheduler->getHistograms(coreHistograms);
+    }));
+  }
+  for (Future &future : futures) {
+    future.wait();
+  }
+  for (const std::unique_ptr<SchedulerHistograms> &coreHistograms
+       : histogramsList) {
+    histograms->merge(*coreHistograms);
+  }
+}
+
+std::string FormatMetrics(const std::vector<SchedulerMetrics> &metricsList,
+                          const SchedulerHistograms &histograms)
+{
+  std::ostringstream stream;
+  for (const MetricDescriptor &descriptor : MetricDescriptors) {
+    stream << "# HELP " << descriptor.name << ' ' << descriptor.help << '\n'
+           << "# TYPE " << descriptor.name << ' ' << descriptor.type << '\n';
+    if (metricsList.size() == 1) {
+      stream << descriptor.name << ' '
+             << metricsList.front().*descriptor.field << '\n';
+      continue;
+    }
+    for (int core = 0; core < metricsList.size(); ++core) {
+      stream << descriptor.name << "{core=\"" << core << "\"} "
+             << metricsList[core].*descriptor.field << '\n';
+    }
+  }
+  for (const HistogramDescriptor &descriptor : HistogramDescriptors) {
+    if (descriptor.help != nullptr) {
+      stream << "# HELP " << descriptor.name << ' ' << descriptor.help
+             << '\n' << "# TYPE " << descriptor.name << " summary\n";
+    }
+    const Histogram &histogram = histograms.*descriptor.field;
+    for (double quantile : Quantiles) {
+      stream << descriptor.name << '{' << descriptor.labels << "quantile=\""
+             << quantile << "\"} " << histogram.getPercentile(quantile * 100)
+             << '\n';
+    }
+    std::string labels(descriptor.labels);
+    if (!labels.empty()) {
+      labels.back() = '}';
+      labels.insert(0, 1, '{');
+    }
+    stream << descriptor.name << "_sum" << labels << ' '
+           << histogram.getSum() << '\n'
+           << descriptor.name << "_count" << labels << ' '
+           << histogram.getCount() << '\n';
+  }
+  return stream.str();
+}
+
+void HandleMetricsRequest(int fd)
+{
+  char buffer[1024];
+  ssize_t n = Read(fd, buffer, sizeof buffer, TARA_METRICS_REQUEST_TIMEOUT);
+  if (n <= 0) {
+    Close(fd);
+    return;
+  }
+  std::vector<SchedulerMetrics> metricsList;
+  std::unique_ptr<SchedulerHistograms> histograms(new SchedulerHistograms);
+  CollectMetrics(&metricsList, histograms.get());
+  std::string body = FormatMetrics(metricsList, *histograms);
+  std::ostringstream stream;
+  stream << "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: " << body.size() << "\r\n"
+            "Connection: close\r\n"
+            "\r\n" << body;
+  std::string response = stream.str();
+  Write(fd, response.data(), response.size(), TARA_METRICS_REQUEST_TIMEOUT);
+  Close(fd);
+}
+
+void AcceptMetricsRequests(int fd)
+{
+  for (;;) {
+    int subfd = Accept4(fd, nullptr, nullptr, SOCK_CLOEXEC, -1);
+    if (subfd < 0) {
+      if (errno == EBADF) {
+        MetricsFDs.erase(std::find(MetricsFDs.begin(), MetricsFDs.end(),
+                                   fd));
+        return;
+      }
+      TARA_WARNING_LOG("accept4 failed: ", Error(errno));
+      Sleep(TARA_METRICS_ACCEPT_BACKOFF);
+      continue;
+    }
+    Call([subfd] () -> void {
+      HandleMetricsRequest(subfd);
+    });
+  }
+}
+
+} // namespace
+
+} // namespace Tara
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <assert.h>
+#include <stdlib.h>
+#
+#include <memory>
+#include <new>
+#include <utility>
+#
+#include "Error.hxx"
+#include "Log.hxx"
+
+namespace Tara {
+
+template<typename TYPE, unsigned int CHUNK_LENGTH>
+class ObjectPool final
+{
+  static_assert(CHUNK_LENGTH != 0, "CHUNK_LENGTH must not be zero");
+
+  ObjectPool(const ObjectPool &other) = delete;
+  void operator=(const ObjectPool &other) = delete;
+
+public:
+  class Deleter final
+  {
+  public:
+    Deleter() : pool_(nullptr) {}
+    explicit Deleter(ObjectPool *pool) : pool_(pool) {}
+
+    void operator()(TYPE *object) const { assert(pool_ != nullptr);
+                                          pool_->destroyObject(object); }
+
+  private:
+    ObjectPool *pool_;
+  };
+
+  typedef std::unique_ptr<TYPE, Deleter> Pointer;
+
+  ObjectPool() : lastBlock_(nullptr), lastChunk_(nullptr) {}
+  ~ObjectPool();
+
+  template<typename... ARGUMENTS>
+  TYPE *createObject(ARGUMENTS &&...arguments);
+
+  template<typename... ARGUMENTS>
+  Pointer makeObject(ARGUMENTS &&...arguments)
+  { return Pointer(createObject(std::forward<ARGUMENTS>(arguments)...),
+                   Deleter(this)); }
+
+  void destroyObject(TYPE *object);
+  void reserveObjects(unsigned int objectCount);
+
+private:
+  union Block
+  {
+    Block *prev;
+    alignas(TYPE) unsigned char base[sizeof(TYPE)];
+  };
+
+  struct Chunk
+  {
+    Chunk *prev;
+    Block blocks[CHUNK_LENGTH];
+  };
+
+  Block *lastBlock_;
+  Chunk *lastChunk_;
+
+  void increaseBlocks();
+};
+
+template<typename TYPE, unsigned int CHUNK_LENGTH>
+ObjectPool<TYPE, CHUNK_LENGTH>::~ObjectPool()
+{
+  Chunk *chunk = lastChunk_;
+  while (chunk != nullptr) {
+    Chunk *chunkPrev = chunk->prev;
+    free(chunk);
+    chunk = chunkPrev;
+  }
+}
+
+template<typename TYPE, unsigned int CHUNK_LENGTH>
+template<typename... ARGUMENTS>
+TYPE *ObjectPool<TYPE, CHUNK_LENGTH>::createObject(ARGUMENTS &&...arguments)
+{
+  if (lastBlock_ == nullptr) {
+    increaseBlocks();
+  }
+  Block *block = lastBlock_;
+  lastBlock_ = block->prev;
+  try {
+    return new (block->base) TYPE(std::forward<ARGUMENTS>(arguments)...);
+  } catch (...) {
+    block->prev = lastBlock_;
+    lastBlock_ = block;
+    throw;
+  }
+}
+
+template<typename TYPE, unsigned int CHUNK_LENGTH>
+void ObjectPool<TYPE, CHUNK_LENGTH>::destroyObject(TYPE *object)
+{
+  assert(object != nullptr);
+  object->~TYPE();
+  auto block = reinterpret_cast<Block *>(object);
+  block->prev = lastBlock_;
+  lastBlock_ = block;
+}
+
+template<typename TYPE, unsigned int CHUNK_LENGTH>
+void ObjectPool<TYPE, CHUNK_LENGTH>::reserveObjects(unsigned int objectCount)
+{
+  unsigned int chunkCount = 0;
+  for (Chunk *chunk = lastChunk_; chunk != nullptr; chunk = chunk->prev) {
+    ++chunkCount;
+  }
+  for (; chunkCount * CHUNK_LENGTH < objectCount; ++chunkCount) {
+    increaseBlocks();
+  }
+}
+
+template<typename TYPE, unsigned int CHUNK_LENGTH>
+void ObjectPool<TYPE, CHUNK_LENGTH>::increaseBlocks()
+{
+  void *memory;
+  int errorNumber = posix_memalign(&memory, alignof(Chunk), sizeof(Chunk));
+  if (errorNumber != 0) {
+    TARA_FATALITY_LOG("posix_memalign failed: ", Error(errorNumber));
+  }
+  auto chunk = static_cast<Chunk *>(memory);
+  chunk->prev = lastChunk_;
+  lastChunk_ = chunk;
+  Block *blockPrev = lastBlock_;
+  for (unsigned int i = 0; i < CHUNK_LENGTH; ++i) {
+    chunk->blocks[i].prev = blockPrev;
+    blockPrev = &chunk->blocks[i];
+  }
+  lastBlock_ = blockPrev;
+}
+
+} // namespace Tara
@@ -0,0 +1,10 @@
+#pragma once
+
+namespace Tara {
+
+void RegisterQuiescentThread();
+void UnregisterQuiescentThread();
+void EnterQuiescentState();
+void LeaveQuiescentState();
+
+} // namespace Tara
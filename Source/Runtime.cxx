@@ -5,9 +5,11 @@
 #include <unistd.h>
 #
 #include <errno.h>
+#include <stdint.h>
 #
 #include <utility>
 #
+#include "Arena.hxx"
 #include "IOEvent.hxx"
 #include "Log.hxx"
 #include "Scheduler.hxx"
@@ -23,19 +25,43 @@ namespace Tara {
 
 extern thread_local Scheduler *const TheScheduler;
 
-void Call(const Coroutine &coroutine)
+void Call(const Coroutine &coroutine, StackSize stackSize)
 {
   CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
   if (coroutine != nullptr) {
-    TheScheduler->callCoroutine(coroutine);
+    TheScheduler->callCoroutine(coroutine, stackSize,
+                                __builtin_return_address(0));
   }
 }
 
-void Call(Coroutine &&coroutine)
+void Call(Coroutine &&coroutine, StackSize stackSize)
 {
   CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
   if (coroutine != nullptr) {
-    TheScheduler->callCoroutine(std::move(coroutine));
+    TheScheduler->callCoroutine(std::move(coroutine), stackSize,
+                                __builtin_return_address(0));
+  }
+}
+
+void CallNow(const Coroutine &coroutine, StackSize stackSize)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
+  if (coroutine != nullptr) {
+    TheScheduler->callCoroutineNow(coroutine, stackSize,
+                                   __builtin_return_address(0));
+  }
+}
+
+void CallNow(Coroutine &&coroutine, StackSize stackSize)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
+  if (coroutine != nullptr) {
+    TheScheduler->callCoroutineNow(std::move(coroutine), stackSize,
+                                   __builtin_return_address(0));
   }
 }
 
@@ -45,6 +71,12 @@ void Yield()
   TheScheduler->yieldCurrentFiber();
 }
 
+void Checkpoint()
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
+}
+
 void Sleep(int duration)
 {
   CHECK_THE_SCHEDULER;
@@ -57,9 +89,175 @@ void Exit()
   TheScheduler->exitCurrentFiber();
 }
 
+void QuickExit()
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->quickExitCurrentFiber();
+}
+
+void SetFiberCacheCapacity(unsigned int capacity)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->setFiberCacheCapacity(capacity);
+}
+
+void SetFiberStackReleasing(bool enabled)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->setFiberStackReleasing(enabled);
+}
+
+void SetStackProfiling(bool enabled)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->setStackProfiling(enabled);
+}
+
+void ReportStackUsage()
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->reportStackUsage();
+}
+
+void SetFiberAccounting(bool enabled)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->setFiberAccounting(enabled);
+}
+
+int GetFiberStatistics(FiberStatistics *statistics)
+{
+  CHECK_THE_SCHEDULER;
+  if (statistics == nullptr) {
+    errno = EINVAL;
+    return -1;
+  }
+  TheScheduler->getFiberStatistics(statistics);
+  return 0;
+}
+
+unsigned int GetSpawnSiteStatistics(SpawnSiteStatistics *statisticsList,
+                                    unsigned int maxCount)
+{
+  CHECK_THE_SCHEDULER;
+  return TheScheduler->getSpawnSiteStatistics(statisticsList, maxCount);
+}
+
+void ReportFiberAccounting()
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->reportFiberAccounting();
+}
+
+void SetIOBudget(unsigned int operationCount, size_t byteCount)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->setIOBudget(operationCount, byteCount);
+}
+
+void SetPollInterval(unsigned int dispatchCount, int duration)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->setPollInterval(dispatchCount, duration);
+}
+
+void SetVirtualClock(bool enabled)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->setVirtualClock(enabled);
+}
+
+unsigned long long Now()
+{
+  CHECK_THE_SCHEDULER;
+  return TheScheduler->getTime();
+}
+
+void Prewarm(unsigned int fiberCount, unsigned int fdCount,
+             StackSize stackSize)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->prewarm(fiberCount, stackSize, fdCount);
+}
+
+void SetOverloadThreshold(int lag, unsigned int readyCount)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->setOverloadThreshold(lag, readyCount);
+}
+
+bool Overloaded()
+{
+  CHECK_THE_SCHEDULER;
+  return TheScheduler->isOverloaded();
+}
+
+void EnablePreemption(int timeSlice)
+{
+  CHECK_THE_SCHEDULER;
+  if (timeSlice > 0) {
+    TheScheduler->enablePreemption(timeSlice);
+  } else {
+    TheScheduler->disablePreemption();
+  }
+}
+
+void DisablePreemption()
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->disablePreemption();
+}
+
+void AllowAsyncPreemption(bool allowed)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->allowAsyncPreemption(allowed);
+}
+
+int CreateFiberGroup(unsigned int weight)
+{
+  CHECK_THE_SCHEDULER;
+  return TheScheduler->createFiberGroup(weight);
+}
+
+int SetFiberGroupWeight(int group, unsigned int weight)
+{
+  CHECK_THE_SCHEDULER;
+  return TheScheduler->setFiberGroupWeight(group, weight);
+}
+
+int JoinFiberGroup(int group)
+{
+  CHECK_THE_SCHEDULER;
+  return TheScheduler->joinFiberGroup(group);
+}
+
+int GetFiberGroup()
+{
+  CHECK_THE_SCHEDULER;
+  return TheScheduler->getCurrentFiberGroup();
+}
+
+int GetFiberGroupStatistics(int group, FiberGroupStatistics *statistics)
+{
+  CHECK_THE_SCHEDULER;
+  if (statistics == nullptr) {
+    errno = EINVAL;
+    return -1;
+  }
+  return TheScheduler->getFiberGroupStatistics(group, statistics);
+}
+
+FiberArena &Arena()
+{
+  CHECK_THE_SCHEDULER;
+  return TheScheduler->getCurrentFiberArena();
+}
+
 int Open(const char *path, int flags, mode_t mode)
 {
   CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
   int fd;
   do {
     fd = open(path, flags | O_NONBLOCK, mode);
@@ -77,6 +275,7 @@ int Open(const char *path, int flags, mode_t mode)
 int Pipe2(int *fds, int flags)
 {
   CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
   if (pipe2(fds, flags | O_NONBLOCK) < 0) {
     return -1;
   }
@@ -88,6 +287,7 @@ int Pipe2(int *fds, int flags)
 int Socket(int domain, int type, int protocol)
 {
   CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
   int fd = socket(domain, type | SOCK_NONBLOCK, protocol);
   if (fd < 0) {
     return -1;
@@ -99,6 +299,7 @@ int Socket(int domain, int type, int protocol)
 int Close(int fd)
 {
   CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
   if (!TheScheduler->ioIsWatched(fd)) {
     errno = EBADF;
     return -1;
@@ -120,6 +321,7 @@ int Close(int fd)
 ssize_t Read(int fd, void *buf, size_t buflen, int timeout)
 {
   CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
   if (!TheScheduler->ioIsWatched(fd)) {
     errno = EBADF;
     return -1;
@@ -144,12 +346,14 @@ ssize_t Read(int fd, void *buf, size_t buflen, int timeout)
   if (n < 0) {
     return -1;
   }
+  TheScheduler->chargeIO(IOEvent::Readability, n);
   return n;
 }
 
 ssize_t Write(int fd, const void *buf, size_t buflen, int timeout)
 {
   CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
   if (!TheScheduler->ioIsWatched(fd)) {
     errno = EBADF;
     return -1;
@@ -174,16 +378,30 @@ ssize_t Write(int fd, const void *buf, size_t buflen, int timeout)
   if (n < 0) {
     return -1;
   }
+  TheScheduler->chargeIO(IOEvent::Writability, n);
   return n;
 }
 
 int Accept4(int fd, sockaddr *addr, socklen_t *addrlen, int flags, int timeout)
 {
   CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
   if (!TheScheduler->ioIsWatched(fd)) {
     errno = EBADF;
     return -1;
   }
+  uint64_t deadline = timeout < 0 ? UINT64_MAX
+                                  : TheScheduler->getTime() + timeout;
+  for (;;) {
+    int backoff = TheScheduler->calculateBackoff(deadline);
+    if (backoff == 0) {
+      break;
+    }
+    if (backoff < 0) {
+      return -1;
+    }
+    TheScheduler->sleepCurrentFiber(backoff);
+  }
   int subfd;
   for (;;) {
     subfd = accept4(fd, addr, addrlen, flags | SOCK_NONBLOCK);
@@ -191,6 +409,7 @@ int Accept4(int fd, sockaddr *addr, socklen_t *addrlen, int flags, int timeout)
       break;
     }
     if (errno == EWOULDBLOCK) {
+      timeout = TheScheduler->calculateTimeout(deadline);
       if (TheScheduler->awaitIOEvent(fd, IOEvent::Readability, timeout) < 0) {
         break;
       }
@@ -205,12 +424,14 @@ int Accept4(int fd, sockaddr *addr, socklen_t *addrlen, int flags, int timeout)
     return -1;
   }
   TheScheduler->watchIO(subfd);
+  TheScheduler->chargeIO(IOEvent::Readability, 0);
   return subfd;
 }
 
 int Connect(int fd, const sockaddr *addr, socklen_t addrlen, int timeout)
 {
   CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
   if (!TheScheduler->ioIsWatched(fd)) {
     errno = EBADF;
     return -1;
@@ -238,6 +459,7 @@ int Connect(int fd, const sockaddr *addr, socklen_t addrlen, int timeout)
 ssize_t Recv(int fd, void *buf, size_t buflen, int flags, int timeout)
 {
   CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
   if (!TheScheduler->ioIsWatched(fd)) {
     errno = EBADF;
     return -1;
@@ -262,12 +484,14 @@ ssize_t Recv(int fd, void *buf, size_t buflen, int flags, int timeout)
   if (n < 0) {
     return -1;
   }
+  TheScheduler->chargeIO(IOEvent::Readability, n);
   return n;
 }
 
 ssize_t Send(int fd, const void *buf, size_t buflen, int flags, int timeout)
 {
   CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
   if (!TheScheduler->ioIsWatched(fd)) {
     errno = EBADF;
     return -1;
@@ -292,6 +516,7 @@ ssize_t Send(int fd, const void *buf, size_t buflen, int flags, int timeout)
   if (n < 0) {
     return -1;
   }
+  TheScheduler->chargeIO(IOEvent::Writability, n);
   return n;
 }
 
@@ -299,6 +524,7 @@ ssize_t RecvFrom(int fd, void *buf, size_t buflen, int flags, sockaddr *addr,
                  socklen_t *addrlen, int timeout)
 {
   CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
   if (!TheScheduler->ioIsWatched(fd)) {
     errno = EBADF;
     return -1;
@@ -323,6 +549,7 @@ ssize_t RecvFrom(int fd, void *buf, size_t buflen, int flags, sockaddr *addr,
   if (n < 0) {
     return -1;
   }
+  TheScheduler->chargeIO(IOEvent::Readability, n);
   return n;
 }
 
@@ -330,6 +557,7 @@ ssize_t SendTo(int fd, const void *buf, size_t buflen, int flags,
                const sockaddr *addr, socklen_t addrlen, int timeout)
 {
   CHECK_THE_SCHEDULER;
+  TheScheduler->checkpoint();
   if (!TheScheduler->ioIsWatched(fd)) {
     errno = EBADF;
     return -1;
@@ -354,6 +582,7 @@ ssize_t SendTo(int fd, const void *buf, size_t buflen, int flags,
   if (n < 0) {
     return -1;
   }
+  TheScheduler->chargeIO(IOEvent::Writability, n);
   return n;
 }
 
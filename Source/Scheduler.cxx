@@ -1,163 +1,982 @@
 #include "Scheduler.hxx"
 
+#include <execinfo.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#
 #include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #
+#include <exception>
 #include <utility>
 #
 #ifdef USE_VALGRIND
 #include <valgrind/valgrind.h>
 #endif
 #
+#include "Arena.hxx"
+#include "Clock.hxx"
+#include "Error.hxx"
+#include "IOEvent.hxx"
 #include "Log.hxx"
+#include "Metrics.hxx"
+#include "Quiescence.hxx"
 #include "RunFiber.hxx"
+#include "Runtime.hxx"
 #include "TimerItem.hxx"
 #include "Utility.hxx"
+#include "Watchdog.hxx"
+
+#define TARA_MIN_REGION_SIZE 8192
+#define TARA_MAX_STACK_CLASS 7
+#define TARA_ARENA_PAGE_SIZE 4096
+#define TARA_FIBER_CACHE_CAPACITY 1024
+#define TARA_FIBER_CACHE_TRIM_INTERVAL 1000
+#define TARA_STACK_PAINT UINT64_C(0xA5A5A5A5A5A5A5A5)
+#define TARA_STACK_RED_ZONE_SIZE 1024
+#define TARA_STACK_AUTO_SIZING_SAMPLE_COUNT 64
+#define TARA_STACK_AUTO_SIZING_MARGIN 50
+#define TARA_PREEMPTION_SIGNAL SIGURG
+#define TARA_STALL_BACKTRACE_DEPTH 64
+#define TARA_IO_OPERATION_BUDGET 64
+#define TARA_IO_BYTE_BUDGET (1024 * 1024)
+#define TARA_POLL_DISPATCH_INTERVAL 64
+#define TARA_POLL_TIME_INTERVAL 2
+#define TARA_FIBER_GROUP_QUANTUM 1000000
+#define TARA_OVERLOAD_LAG 50
+#define TARA_OVERLOAD_READY_FIBER_COUNT 10000
+#define TARA_OVERLOAD_BACKOFF 5
 
-#define TARA_REGION_SIZE 65536
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
 
 namespace Tara {
 
-struct Fiber final
+struct alignas(max_align_t) Fiber final : Waiter
 {
-  QUEUE queueItem;
-  TimerItem timerItem;
   const Coroutine coroutine;
+  const unsigned int stackClass;
   unsigned char *const stack;
   const size_t stackSize;
 #ifdef USE_VALGRIND
   const unsigned int stackID;
 #endif
   jmp_buf *context;
-  int status;
-  int fd;
+  bool stackIsReleased;
+  bool stackIsPainted;
+  SpawnSite *spawnSite;
+  const void *spawnSiteAddress;
+  bool asyncPreemptionIsAllowed;
+  bool quickExitIsForbidden;
+  uint64_t switchTime;
+  FiberStatistics statistics;
+  FiberArena arena;
 
-  Fiber(const Coroutine &coroutine, unsigned char *stack, size_t stackSize);
-  Fiber(Coroutine &&coroutine, unsigned char *stack, size_t stackSize);
+  Fiber(unsigned int stackClass, unsigned char *stack, size_t stackSize,
+        MemoryPool *arenaPagePool);
   ~Fiber();
 };
 
+class Scheduler::RuntimeSection final
+{
+  RuntimeSection(const RuntimeSection &other) = delete;
+  void operator=(const RuntimeSection &other) = delete;
+
+public:
+  explicit RuntimeSection(const Scheduler *scheduler)
+    : scheduler_(scheduler), wasInRuntime_(scheduler->isInRuntime_)
+  { scheduler->isInRuntime_ = 1; SignalFence(); }
+
+  ~RuntimeSection()
+  { SignalFence(); scheduler_->isInRuntime_ = wasInRuntime_; }
+
+private:
+  const Scheduler *const scheduler_;
+  const sig_atomic_t wasInRuntime_;
+};
+
 namespace {
 
 class UnwindStack final
 {};
 
-Fiber *CreateFiber(const Coroutine &coroutine);
-Fiber *CreateFiber(Coroutine &&coroutine);
+const unsigned int StackClasses[] = {
+  [static_cast<int>(StackSize::Small)] = 1,
+  [static_cast<int>(StackSize::Medium)] = 3,
+  [static_cast<int>(StackSize::Large)] = 5,
+  [static_cast<int>(StackSize::Huge)] = 7,
+  [static_cast<int>(StackSize::Auto)] = 3
+};
+
+Fiber *CreateFiber(unsigned int stackClass, MemoryPool *arenaPagePool);
 void DestroyFiber(Fiber *fiber);
+void ReleaseFiberStack(Fiber *fiber);
+void PaintStack(unsigned char *stack, unsigned char *stackEnd);
+void PrefaultStack(unsigned char *stack, unsigned char *stackEnd);
+unsigned char *FindStackHighWaterMark(const Fiber *fiber);
+char *AppendString(char *buffer, char *bufferEnd, const char *string);
+char *AppendNumber(char *buffer, char *bufferEnd, unsigned long long number,
+                   unsigned int base);
+unsigned int ChooseStackClass(const SpawnSite *spawnSite);
 void FiberStart(Scheduler *scheduler) noexcept;
 
+long xsysconf(int name);
+void xmadvise(void *addr, size_t length, int advice);
+void xsigaction(int signum, const struct sigaction *act,
+                struct sigaction *oldact);
+void xthread_sigmask(int how, const sigset_t *set, sigset_t *oldset);
+void xtimer_create(clockid_t clockid, sigevent *sevp, timer_t *timerid);
+void xtimer_settime(timer_t timerid, int flags, const itimerspec *new_value,
+                    itimerspec *old_value);
+void xtimer_delete(timer_t timerid);
+
 } // namespace
 
 Scheduler::Scheduler()
-  : fiberCount_(0), context_(nullptr), status_(0), runningFiber_(nullptr),
+  : fiberCount_(0), deadFiberCount_(0),
+    fiberCacheCapacity_(TARA_FIBER_CACHE_CAPACITY),
+    fiberStackReleasing_(false), fiberCacheTrimTime_(GetTime()),
+    createdFiberCount_(0), recycledFiberCount_(0), destroyedFiberCount_(0),
+    stackProfiling_(false), fiberAccounting_(false),
+    context_(nullptr), status_(0), runningFiber_(nullptr),
+    stacklessWaiter_(nullptr), stacklessGroup_(nullptr),
+    stacklessTaskCount_(0), dispatchCount_(0), heartbeat_(0), isIdle_(true),
+    watchdogIsPrepared_(false),
+    preemptionIsEnabled_(false), preemptionDispatchCount_(0),
+    preemptionIsRequested_(0), isInRuntime_(0), suspendedFiberCount_(0),
+    ioOperationBudget_(TARA_IO_OPERATION_BUDGET),
+    ioByteBudget_(TARA_IO_BYTE_BUDGET), ioOperationCount_(0), ioByteCount_(0),
+    ioWrittenByteCount_(0),
+    pollDispatchInterval_(TARA_POLL_DISPATCH_INTERVAL),
+    pollTimeInterval_(TARA_POLL_TIME_INTERVAL), pollDispatchCount_(0),
+    pollTime_(0), readyFiberCount_(0), sliceStartTime_(0), dispatchTime_(0),
+    readyLag_(0),
+    overloadLag_(TARA_OVERLOAD_LAG * 1000),
+    overloadReadyCount_(TARA_OVERLOAD_READY_FIBER_COUNT),
+    arenaPagePool_(TARA_ARENA_PAGE_SIZE, 16),
     async_(this)
 {
-  QUEUE_INIT(&readyFiberQueue_);
-  QUEUE_INIT(&deadFiberQueue_);
+  for (int i = 0; i < TARA_LENGTH_OF(fiberCaches_); ++i) {
+    FiberCache *fiberCache = &fiberCaches_[i];
+    QUEUE_INIT(&fiberCache->deadFiberQueue);
+    fiberCache->deadFiberCount = 0;
+    fiberCache->minDeadFiberCount = 0;
+    fiberCache->reservedFiberCount = 0;
+  }
+  QUEUE_INIT(&activeFiberGroupQueue_);
+  createFiberGroup(1);
+  RegisterQuiescentThread();
+  RegisterWatchedScheduler(this);
 }
 
-void Scheduler::callCoroutine(const Coroutine &coroutine)
+Scheduler::~Scheduler()
 {
-  Fiber *fiber;
-  if (!QUEUE_EMPTY(&deadFiberQueue_)) {
-    fiber = QUEUE_DATA(QUEUE_HEAD(&deadFiberQueue_), Fiber, queueItem);
-    QUEUE_REMOVE(&fiber->queueItem);
-    const_cast<Coroutine &>(fiber->coroutine) = coroutine;
-  } else {
-    fiber = CreateFiber(coroutine);
-    ++fiberCount_;
+  UnregisterWatchedScheduler(this);
+  UnregisterQuiescentThread();
+  disablePreemption();
+}
+
+void Scheduler::callCoroutine(const Coroutine &coroutine, StackSize stackSize,
+                              const void *spawnSiteAddress)
+{
+  RuntimeSection runtimeSection(this);
+  Fiber *fiber = allocateFiber(stackSize, spawnSiteAddress);
+  const_cast<Coroutine &>(fiber->coroutine) = coroutine;
+  insertWokenWaiter(fiber);
+}
+
+void Scheduler::callCoroutine(Coroutine &&coroutine, StackSize stackSize,
+                              const void *spawnSiteAddress)
+{
+  RuntimeSection runtimeSection(this);
+  Fiber *fiber = allocateFiber(stackSize, spawnSiteAddress);
+  const_cast<Coroutine &>(fiber->coroutine) = std::move(coroutine);
+  insertWokenWaiter(fiber);
+}
+
+void Scheduler::callCoroutineNow(const Coroutine &coroutine,
+                                 StackSize stackSize,
+                                 const void *spawnSiteAddress)
+{
+  RuntimeSection runtimeSection(this);
+  Fiber *fiber = allocateFiber(stackSize, spawnSiteAddress);
+  const_cast<Coroutine &>(fiber->coroutine) = coroutine;
+  if (runningFiber_ == nullptr) {
+    insertReadyWaiterHead(fiber);
+    return;
   }
-  QUEUE_INSERT_TAIL(&readyFiberQueue_, &fiber->queueItem);
+  switchToFiber(fiber);
 }
 
-void Scheduler::callCoroutine(Coroutine &&coroutine)
+void Scheduler::callCoroutineNow(Coroutine &&coroutine, StackSize stackSize,
+                                 const void *spawnSiteAddress)
 {
-  Fiber *fiber;
-  if (!QUEUE_EMPTY(&deadFiberQueue_)) {
-    fiber = QUEUE_DATA(QUEUE_HEAD(&deadFiberQueue_), Fiber, queueItem);
-    QUEUE_REMOVE(&fiber->queueItem);
-    const_cast<Coroutine &>(fiber->coroutine) = std::move(coroutine);
-  } else {
-    fiber = CreateFiber(std::move(coroutine));
+  RuntimeSection runtimeSection(this);
+  Fiber *fiber = allocateFiber(stackSize, spawnSiteAddress);
+  const_cast<Coroutine &>(fiber->coroutine) = std::move(coroutine);
+  if (runningFiber_ == nullptr) {
+    insertReadyWaiterHead(fiber);
+    return;
+  }
+  switchToFiber(fiber);
+}
+
+void Scheduler::setIOBudget(unsigned int operationCount, size_t byteCount)
+{
+  ioOperationBudget_ = operationCount == 0 ? UINT_MAX : operationCount;
+  ioByteBudget_ = byteCount == 0 ? SIZE_MAX : byteCount;
+}
+
+void Scheduler::setPollInterval(unsigned int dispatchCount, int duration)
+{
+  pollDispatchInterval_ = dispatchCount == 0 ? ULONG_MAX : dispatchCount;
+  pollTimeInterval_ = duration < 0 ? UINT64_MAX : duration;
+}
+
+void Scheduler::setOverloadThreshold(int lag, unsigned int readyFiberCount)
+{
+  overloadLag_ = lag < 0 ? UINT64_MAX : lag * UINT64_C(1000);
+  overloadReadyCount_ = readyFiberCount == 0 ? UINT_MAX : readyFiberCount;
+}
+
+int Scheduler::calculateBackoff(uint64_t deadline) const
+{
+  if (!isOverloaded()) {
+    return 0;
+  }
+  uint64_t now = timer_.getTime();
+  if (now >= deadline) {
+    errno = ETIME;
+    return -1;
+  }
+  return deadline - now < TARA_OVERLOAD_BACKOFF ? deadline - now
+                                                : TARA_OVERLOAD_BACKOFF;
+}
+
+int Scheduler::calculateTimeout(uint64_t deadline) const
+{
+  if (deadline == UINT64_MAX) {
+    return -1;
+  }
+  uint64_t now = timer_.getTime();
+  if (now >= deadline) {
+    return 0;
+  }
+  return deadline - now < INT_MAX ? deadline - now : INT_MAX;
+}
+
+void Scheduler::prewarm(unsigned int fiberCount, StackSize stackSize,
+                        unsigned int fdCount)
+{
+  RuntimeSection runtimeSection(this);
+  unsigned int stackClass = StackClasses[static_cast<int>(stackSize)];
+  assert(stackClass < TARA_LENGTH_OF(fiberCaches_));
+  FiberCache *fiberCache = &fiberCaches_[stackClass];
+  while (fiberCache->deadFiberCount < fiberCount) {
+    Fiber *fiber = CreateFiber(stackClass, &arenaPagePool_);
+    PrefaultStack(fiber->stack, fiber->stack + fiber->stackSize);
+    QUEUE_INSERT_HEAD(&fiberCache->deadFiberQueue, &fiber->queueItem);
+    ++createdFiberCount_;
     ++fiberCount_;
+    ++deadFiberCount_;
+    ++fiberCache->deadFiberCount;
+  }
+  if (fiberCache->reservedFiberCount < fiberCount) {
+    fiberCache->reservedFiberCount = fiberCount;
   }
-  QUEUE_INSERT_TAIL(&readyFiberQueue_, &fiber->queueItem);
+  arenaPagePool_.reserveBlocks(fiberCount);
+  ioPoll_.reserveWatchers(fdCount);
 }
 
-void Scheduler::run()
+void Scheduler::enablePreemption(int timeSlice)
 {
-  assert(runningFiber_ == nullptr);
-  if (fiberCount_ == 0) {
+  RuntimeSection runtimeSection(this);
+  assert(timeSlice > 0);
+  if (!preemptionIsEnabled_) {
+    struct sigaction action;
+    action.sa_sigaction = PreemptionSignalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    xsigaction(TARA_PREEMPTION_SIGNAL, &action, nullptr);
+    sigevent event;
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = TARA_PREEMPTION_SIGNAL;
+    event.sigev_value.sival_ptr = this;
+    event.sigev_notify_thread_id = syscall(SYS_gettid);
+    xtimer_create(CLOCK_THREAD_CPUTIME_ID, &event, &preemptionTimer_);
+    preemptionIsEnabled_ = true;
+  }
+  itimerspec time;
+  time.it_interval.tv_sec = timeSlice / 1000;
+  time.it_interval.tv_nsec = timeSlice % 1000 * 1000000;
+  time.it_value = time.it_interval;
+  xtimer_settime(preemptionTimer_, 0, &time, nullptr);
+}
+
+void Scheduler::disablePreemption()
+{
+  RuntimeSection runtimeSection(this);
+  if (!preemptionIsEnabled_) {
     return;
   }
+  xtimer_delete(preemptionTimer_);
+  preemptionIsEnabled_ = false;
+  preemptionIsRequested_ = 0;
+}
+
+void Scheduler::allowAsyncPreemption(bool allowed)
+{
+  assert(runningFiber_ != nullptr);
+  runningFiber_->asyncPreemptionIsAllowed = allowed;
+}
+
+int Scheduler::createFiberGroup(unsigned int weight)
+{
+  RuntimeSection runtimeSection(this);
+  if (weight == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  FiberGroup *fiberGroup = fiberGroupPool_.createObject();
+  QUEUE_INIT(&fiberGroup->readyFiberQueue);
+  fiberGroup->id = fiberGroups_.size();
+  fiberGroup->weight = weight;
+  fiberGroup->isActive = false;
+  fiberGroup->deficit = 0;
+  fiberGroup->dispatchCount = 0;
+  fiberGroup->cpuTime = 0;
+  fiberGroups_.push_back(fiberGroup);
+  return fiberGroup->id;
+}
+
+int Scheduler::setFiberGroupWeight(int fiberGroupID, unsigned int weight)
+{
+  RuntimeSection runtimeSection(this);
+  if (fiberGroupID < 0 ||
+      static_cast<size_t>(fiberGroupID) >= fiberGroups_.size() ||
+      weight == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  fiberGroups_[fiberGroupID]->weight = weight;
+  return 0;
+}
+
+int Scheduler::joinFiberGroup(int fiberGroupID)
+{
+  RuntimeSection runtimeSection(this);
+  assert(runningFiber_ != nullptr);
+  if (fiberGroupID < 0 ||
+      static_cast<size_t>(fiberGroupID) >= fiberGroups_.size()) {
+    errno = EINVAL;
+    return -1;
+  }
+  chargeCPUTime();
+  runningFiber_->group = fiberGroups_[fiberGroupID];
+  return 0;
+}
+
+int Scheduler::getCurrentFiberGroup() const
+{
+  assert(runningFiber_ != nullptr);
+  return runningFiber_->group->id;
+}
+
+int Scheduler::getFiberGroupStatistics(int fiberGroupID,
+                                       FiberGroupStatistics *statistics) const
+{
+  assert(statistics != nullptr);
+  if (fiberGroupID < 0 ||
+      static_cast<size_t>(fiberGroupID) >= fiberGroups_.size()) {
+    errno = EINVAL;
+    return -1;
+  }
+  const FiberGroup *fiberGroup = fiberGroups_[fiberGroupID];
+  statistics->weight = fiberGroup->weight;
+  statistics->dispatchCount = fiberGroup->dispatchCount;
+  statistics->cpuTime = fiberGroup->cpuTime;
+  return 0;
+}
+
+void Scheduler::getMetrics(SchedulerMetrics *metrics) const
+{
+  assert(metrics != nullptr);
+  metrics->dispatchCount = dispatchCount_;
+  metrics->fiberCount = fiberCount_ - deadFiberCount_;
+  metrics->cachedFiberCount = deadFiberCount_;
+  metrics->readyFiberCount = readyFiberCount_;
+  metrics->createdFiberCount = createdFiberCount_;
+  metrics->recycledFiberCount = recycledFiberCount_;
+  metrics->destroyedFiberCount = destroyedFiberCount_;
+  metrics->pollCount = ioPoll_.getWaitCount();
+  metrics->pollEventCount = ioPoll_.getEventCount();
+  metrics->pollControlCount = ioPoll_.getControlCount();
+  metrics->timerCount = timer_.getItemCount();
+  metrics->asyncJobCount = async_.getJobCount();
+  metrics->readyLag = readyLag_;
+}
+
+void Scheduler::getHistograms(SchedulerHistograms *histograms) const
+{
+  assert(histograms != nullptr);
+  histograms->readabilityWait = readabilityWaitHistogram_;
+  histograms->writabilityWait = writabilityWaitHistogram_;
+  histograms->runSlice = runSliceHistogram_;
+  histograms->dispatchDelay = dispatchDelayHistogram_;
+  histograms->asyncQueueWait = async_.getQueueWaitHistogram();
+  histograms->asyncService = async_.getServiceHistogram();
+}
+
+void Scheduler::reportStackUsage() const
+{
+  RuntimeSection runtimeSection(this);
+  for (const auto &spawnSiteEntry : spawnSites_) {
+    const SpawnSite &spawnSite = spawnSiteEntry.second;
+    if (spawnSite.stackUsageSampleCount == 0) {
+      continue;
+    }
+    TARA_INFORMING_LOG("stack usage: site=", spawnSite.address,
+                       " samples=", spawnSite.stackUsageSampleCount,
+                       " p50=", spawnSite.calculateStackUsage(50),
+                       " p99=", spawnSite.calculateStackUsage(99),
+                       " max=", spawnSite.maxStackUsage,
+                       " region=", TARA_MIN_REGION_SIZE <<
+                                   spawnSite.stackClass);
+  }
+}
+
+void Scheduler::getFiberStatistics(FiberStatistics *statistics)
+{
+  RuntimeSection runtimeSection(this);
+  assert(runningFiber_ != nullptr);
+  assert(statistics != nullptr);
+  chargeCPUTime();
+  *statistics = runningFiber_->statistics;
+  statistics->cpuTime += sliceStartTime_ - dispatchTime_;
+  statistics->readByteCount += ioByteCount_ - ioWrittenByteCount_;
+  statistics->writtenByteCount += ioWrittenByteCount_;
+}
+
+unsigned int Scheduler::getSpawnSiteStatistics(
+  SpawnSiteStatistics *statisticsList, unsigned int maxCount) const
+{
+  RuntimeSection runtimeSection(this);
+  unsigned int count = 0;
+  for (const auto &spawnSiteEntry : spawnSites_) {
+    const SpawnSite &spawnSite = spawnSiteEntry.second;
+    if (spawnSite.fiberCount == 0) {
+      continue;
+    }
+    if (count < maxCount) {
+      SpawnSiteStatistics *statistics = &statisticsList[count];
+      statistics->address = spawnSite.address;
+      statistics->fiberCount = spawnSite.fiberCount;
+      statistics->total = spawnSite.fiberStatistics;
+    }
+    ++count;
+  }
+  return count;
+}
+
+void Scheduler::reportFiberAccounting() const
+{
+  RuntimeSection runtimeSection(this);
+  for (const auto &spawnSiteEntry : spawnSites_) {
+    const SpawnSite &spawnSite = spawnSiteEntry.second;
+    if (spawnSite.fiberCount == 0) {
+      continue;
+    }
+    const FiberStatistics &statistics = spawnSite.fiberStatistics;
+    TARA_INFORMING_LOG("fiber accounting: site=", spawnSite.address,
+                       " fibers=", spawnSite.fiberCount,
+                       " switches=", statistics.switchCount,
+                       " cpu_time=", statistics.cpuTime,
+                       " wait_time=", statistics.waitTime,
+                       " bytes_read=", statistics.readByteCount,
+                       " bytes_written=", statistics.writtenByteCount);
+  }
+}
+
+void Scheduler::reportStall() const
+{
+  char buffer[256];
+  char *bufferEnd = buffer + sizeof buffer;
+  char *p = AppendString(buffer, bufferEnd, "Tara: Warning: stalled ");
+  if (runningFiber_ != nullptr) {
+    p = AppendString(p, bufferEnd, "fiber: fiber=0x");
+    p = AppendNumber(p, bufferEnd,
+                     reinterpret_cast<uintptr_t>(runningFiber_), 16);
+    p = AppendString(p, bufferEnd, " site=0x");
+    p = AppendNumber(p, bufferEnd, reinterpret_cast<uintptr_t>
+                                   (runningFiber_->spawnSiteAddress), 16);
+    p = AppendString(p, bufferEnd, " switches=");
+    p = AppendNumber(p, bufferEnd, runningFiber_->statistics.switchCount,
+                     10);
+  } else if (stacklessGroup_ != nullptr) {
+    p = AppendString(p, bufferEnd, "stackless task:");
+  } else {
+    p = AppendString(p, bufferEnd, "scheduler:");
+  }
+  p = AppendString(p, bufferEnd, " dispatches=");
+  p = AppendNumber(p, bufferEnd, dispatchCount_, 10);
+  p = AppendString(p, bufferEnd, "\n");
+  static_cast<void>(write(STDERR_FILENO, buffer, p - buffer));
+  void *addresses[TARA_STALL_BACKTRACE_DEPTH];
+  int addressCount = backtrace(addresses, TARA_LENGTH_OF(addresses));
+  backtrace_symbols_fd(addresses, addressCount, STDERR_FILENO);
+}
+
+FiberArena &Scheduler::getCurrentFiberArena() const
+{
+  assert(runningFiber_ != nullptr);
+  return runningFiber_->arena;
+}
+
+void Scheduler::prepareWatchdog()
+{
+  if (!watchdogIsPrepared_) {
+    watchdogIsPrepared_ = PrepareWatchedScheduler(this);
+  }
+}
+
+bool Scheduler::runOnce(int timeout)
+{
+  assert(runningFiber_ == nullptr);
+  LeaveQuiescentState();
+  Store(isIdle_, false, MemoryOrder::Relaxed);
+  chargeCPUTime();
+  prepareWatchdog();
+  jmp_buf context;
+  context_ = &context;
+  status_ = 1;
+  setjmp(context);
   for (;;) {
-    if (!QUEUE_EMPTY(&readyFiberQueue_)) {
-      jmp_buf context;
-      if (setjmp(context) != 0) {
-        goto no_ready_fiber;
+    Waiter *waiter = stacklessWaiter_;
+    if (waiter != nullptr) {
+      stacklessWaiter_ = nullptr;
+    } else {
+      if (readyFiberCount_ == 0 || pollIsDue()) {
+        break;
       }
-      context_ = &context;
-      status_ = 1;
-      auto fiber = QUEUE_DATA(QUEUE_HEAD(&readyFiberQueue_), Fiber, queueItem);
-      QUEUE_REMOVE(&fiber->queueItem);
-      executeFiber(fiber);
+      waiter = removeReadyWaiter();
     }
-no_ready_fiber:
-    if (!QUEUE_EMPTY(&deadFiberQueue_)) {
-      QUEUE *q = QUEUE_HEAD(&deadFiberQueue_);
-      do {
-        auto fiber = QUEUE_DATA(q, Fiber, queueItem);
-        q = QUEUE_NEXT(q);
-        DestroyFiber(fiber);
-        --fiberCount_;
-      } while (q != &deadFiberQueue_);
-      QUEUE_INIT(&deadFiberQueue_);
-      if (fiberCount_ == 0) {
-        break;
+    if (waiter->resume == nullptr) {
+      executeFiber(static_cast<Fiber *>(waiter));
+    }
+    ++dispatchCount_;
+    beat();
+    chargeCPUTime();
+    recordDispatch(waiter);
+    stacklessGroup_ = waiter->group;
+    waiter->resume(waiter);
+    chargeCPUTime();
+    recordRunSlice();
+    stacklessGroup_ = nullptr;
+  }
+  EnterQuiescentState();
+  Store(isIdle_, true, MemoryOrder::Relaxed);
+  if (deadFiberCount_ == fiberCount_ && stacklessTaskCount_ == 0) {
+    for (int i = 0; i < TARA_LENGTH_OF(fiberCaches_); ++i) {
+      FiberCache *fiberCache = &fiberCaches_[i];
+      destroyDeadFibers(fiberCache, fiberCache->deadFiberCount);
+    }
+    return false;
+  }
+  trimFiberCaches();
+  pollDispatchCount_ = dispatchCount_;
+  pollTime_ = GetTime();
+  {
+    int pollTimeout = calculateTimeout();
+    if (timeout >= 0 && (pollTimeout < 0 || pollTimeout > timeout)) {
+      pollTimeout = timeout;
+    }
+    int clockAdvance = 0;
+    if (timer_.clockIsVirtual() && pollTimeout != 0) {
+      int timerTimeout = timer_.calculateTimeout();
+      if (timeout >= 0 && timerTimeout > timeout) {
+        timerTimeout = timeout;
+      }
+      if (timerTimeout > 0 && ioPoll_.getEventAwaiterCount() == 0 &&
+          suspendedFiberCount_ == 0 && async_.getJobCount() == 0) {
+        timer_.advanceClock(timerTimeout);
+        pollTimeout = 0;
+      } else if (timerTimeout > 0 && pollTimeout > 0) {
+        clockAdvance = pollTimeout;
       }
     }
-    {
-      QUEUE fiberQueue;
-      QUEUE_INIT(&fiberQueue);
-      while (!ioPoll_.waitForEvents(timer_.calculateTimeout(), &fiberQueue));
+    QUEUE fiberQueue;
+    QUEUE_INIT(&fiberQueue);
+    while (!ioPoll_.waitForEvents(pollTimeout, &fiberQueue));
+    chargeCPUTime();
+    if (clockAdvance > 0 && QUEUE_EMPTY(&fiberQueue)) {
+      timer_.advanceClock(clockAdvance);
+    }
+    while (!QUEUE_EMPTY(&fiberQueue)) {
+      auto waiter = QUEUE_DATA(QUEUE_HEAD(&fiberQueue), Waiter, queueItem);
+      QUEUE_REMOVE(&waiter->queueItem);
+      timer_.removeItem(&waiter->timerItem);
+      waiter->fd = -1;
+      insertWokenWaiter(waiter);
+    }
+  }
+  {
+    TimerItem *buffer[1024];
+    unsigned int n = timer_.removeDueItems(buffer, TARA_LENGTH_OF(buffer));
+    for (unsigned int i = 0; i < n; ++i) {
+      auto waiter = TARA_CONTAINER_OF(buffer[i], Waiter, timerItem);
+      if (waiter->fd >= 0) {
+        ioPoll_.removeEventAwaiter(waiter->queueItem, waiter->fd);
+        waiter->fd = -1;
+        waiter->status = -ETIME;
+      }
+      insertWokenWaiter(waiter);
+    }
+  }
+  return true;
+}
+
+Fiber *Scheduler::allocateFiber(StackSize stackSize,
+                                const void *spawnSiteAddress)
+{
+  SpawnSite *spawnSite = nullptr;
+  unsigned int stackClass = StackClasses[static_cast<int>(stackSize)];
+  bool stackIsProfiled = stackProfiling_ || stackSize == StackSize::Auto;
+  if (stackIsProfiled || fiberAccounting_) {
+    spawnSite = &spawnSites_.emplace(spawnSiteAddress, spawnSiteAddress)
+                            .first->second;
+    if (stackSize == StackSize::Auto &&
+        spawnSite->stackUsageSampleCount >=
+        TARA_STACK_AUTO_SIZING_SAMPLE_COUNT) {
+      stackClass = spawnSite->stackClass;
+    }
+  }
+  assert(stackClass < TARA_LENGTH_OF(fiberCaches_));
+  FiberCache *fiberCache = &fiberCaches_[stackClass];
+  Fiber *fiber;
+  if (QUEUE_EMPTY(&fiberCache->deadFiberQueue)) {
+    fiber = CreateFiber(stackClass, &arenaPagePool_);
+    ++createdFiberCount_;
+    ++fiberCount_;
+  } else {
+    fiber = QUEUE_DATA(QUEUE_PREV(&fiberCache->deadFiberQueue), Fiber,
+                       queueItem);
+    QUEUE_REMOVE(&fiber->queueItem);
+    fiber->stackIsReleased = false;
+    ++recycledFiberCount_;
+    --deadFiberCount_;
+    if (--fiberCache->deadFiberCount < fiberCache->minDeadFiberCount) {
+      fiberCache->minDeadFiberCount = fiberCache->deadFiberCount;
+    }
+  }
+  fiber->spawnSite = spawnSite;
+  fiber->spawnSiteAddress = spawnSiteAddress;
+  fiber->asyncPreemptionIsAllowed = false;
+  fiber->quickExitIsForbidden = false;
+  fiber->switchTime = 0;
+  fiber->statistics = FiberStatistics();
+  prepareWaiter(fiber);
+  if (stackIsProfiled && !fiber->stackIsPainted) {
+    PaintStack(fiber->stack, fiber->stack + fiber->stackSize);
+    fiber->stackIsPainted = true;
+  }
+  return fiber;
+}
+
+void Scheduler::destroyDeadFibers(FiberCache *fiberCache,
+                                  unsigned int deadFiberCount)
+{
+  assert(fiberCache != nullptr);
+  assert(deadFiberCount <= fiberCache->deadFiberCount);
+  for (; deadFiberCount != 0; --deadFiberCount) {
+    auto fiber = QUEUE_DATA(QUEUE_HEAD(&fiberCache->deadFiberQueue), Fiber,
+                            queueItem);
+    QUEUE_REMOVE(&fiber->queueItem);
+    DestroyFiber(fiber);
+    ++destroyedFiberCount_;
+    --fiberCount_;
+    --deadFiberCount_;
+    --fiberCache->deadFiberCount;
+  }
+  if (fiberCache->deadFiberCount < fiberCache->minDeadFiberCount) {
+    fiberCache->minDeadFiberCount = fiberCache->deadFiberCount;
+  }
+}
+
+void Scheduler::trimFiberCaches()
+{
+  for (int i = 0; i < TARA_LENGTH_OF(fiberCaches_); ++i) {
+    FiberCache *fiberCache = &fiberCaches_[i];
+    unsigned int capacity = fiberCacheCapacity_;
+    if (capacity < fiberCache->reservedFiberCount) {
+      capacity = fiberCache->reservedFiberCount;
+    }
+    if (fiberCache->deadFiberCount > capacity) {
+      destroyDeadFibers(fiberCache, fiberCache->deadFiberCount - capacity);
+    }
+  }
+  uint64_t now = GetTime();
+  if (now - fiberCacheTrimTime_ < TARA_FIBER_CACHE_TRIM_INTERVAL) {
+    return;
+  }
+  fiberCacheTrimTime_ = now;
+  for (int i = 0; i < TARA_LENGTH_OF(fiberCaches_); ++i) {
+    FiberCache *fiberCache = &fiberCaches_[i];
+    unsigned int deadFiberCount = (fiberCache->minDeadFiberCount + 1) / 2;
+    unsigned int spareFiberCount = 0;
+    if (fiberCache->deadFiberCount > fiberCache->reservedFiberCount) {
+      spareFiberCount = fiberCache->deadFiberCount -
+                        fiberCache->reservedFiberCount;
+    }
+    if (deadFiberCount > spareFiberCount) {
+      deadFiberCount = spareFiberCount;
+    }
+    destroyDeadFibers(fiberCache, deadFiberCount);
+    if (fiberStackReleasing_) {
       QUEUE *q;
-      QUEUE_FOREACH(q, &fiberQueue) {
+      QUEUE_FOREACH(q, &fiberCache->deadFiberQueue) {
         auto fiber = QUEUE_DATA(q, Fiber, queueItem);
-        timer_.removeItem(&fiber->timerItem);
+        if (!fiber->stackIsReleased) {
+          ReleaseFiberStack(fiber);
+          fiber->stackIsReleased = true;
+          fiber->stackIsPainted = false;
+        }
       }
-      if (!QUEUE_EMPTY(&fiberQueue)) {
-        QUEUE_ADD(&readyFiberQueue_, &fiberQueue);
+    }
+    fiberCache->minDeadFiberCount = fiberCache->deadFiberCount;
+  }
+}
+
+int Scheduler::calculateTimeout()
+{
+  if (readyFiberCount_ != 0) {
+    return 0;
+  }
+  int timeout = timer_.calculateTimeout();
+  if (deadFiberCount_ != 0 &&
+      (timeout < 0 || timeout > TARA_FIBER_CACHE_TRIM_INTERVAL)) {
+    timeout = TARA_FIBER_CACHE_TRIM_INTERVAL;
+  }
+  return timeout;
+}
+
+void Scheduler::prepareWaiter(Waiter *waiter) const
+{
+  if (runningFiber_ != nullptr) {
+    waiter->group = runningFiber_->group;
+  } else if (stacklessGroup_ != nullptr) {
+    waiter->group = stacklessGroup_;
+  } else {
+    waiter->group = fiberGroups_[0];
+  }
+}
+
+void Scheduler::insertReadyWaiterHead(Waiter *waiter)
+{
+  FiberGroup *fiberGroup = waiter->group;
+  if (!fiberGroup->isActive) {
+    QUEUE_INSERT_HEAD(&activeFiberGroupQueue_, &fiberGroup->queueItem);
+    fiberGroup->isActive = true;
+  }
+  QUEUE_INSERT_HEAD(&fiberGroup->readyFiberQueue, &waiter->queueItem);
+  waiter->readyTime = GetPreciseTime();
+  ++readyFiberCount_;
+}
+
+void Scheduler::insertReadyWaiterTail(Waiter *waiter)
+{
+  FiberGroup *fiberGroup = waiter->group;
+  if (!fiberGroup->isActive) {
+    QUEUE_INSERT_TAIL(&activeFiberGroupQueue_, &fiberGroup->queueItem);
+    fiberGroup->isActive = true;
+  }
+  QUEUE_INSERT_TAIL(&fiberGroup->readyFiberQueue, &waiter->queueItem);
+  waiter->readyTime = GetPreciseTime();
+  ++readyFiberCount_;
+}
+
+Waiter *Scheduler::removeReadyWaiter()
+{
+  assert(readyFiberCount_ != 0);
+  FiberGroup *fiberGroup;
+  for (;;) {
+    fiberGroup = QUEUE_DATA(QUEUE_HEAD(&activeFiberGroupQueue_), FiberGroup,
+                            queueItem);
+    if (QUEUE_EMPTY(&fiberGroup->readyFiberQueue)) {
+      QUEUE_REMOVE(&fiberGroup->queueItem);
+      fiberGroup->isActive = false;
+      if (fiberGroup->deficit > 0) {
+        fiberGroup->deficit = 0;
       }
+      continue;
     }
-    {
-      TimerItem *buffer[1024];
-      unsigned int n = timer_.removeDueItems(buffer, TARA_LENGTH_OF(buffer));
-      for (int i = n - 1; i >= 0; --i) {
-        auto fiber = TARA_CONTAINER_OF(buffer[i], Fiber, timerItem);
-        if (fiber->fd >= 0) {
-          ioPoll_.removeEventAwaiter(fiber->queueItem, fiber->fd);
-          fiber->fd = -1;
-          fiber->status = -ETIME;
-        }
-        QUEUE_INSERT_HEAD(&readyFiberQueue_, &fiber->queueItem);
+    if (fiberGroup->deficit > 0) {
+      break;
+    }
+    int64_t quantum = static_cast<int64_t>(fiberGroup->weight) *
+                      TARA_FIBER_GROUP_QUANTUM;
+    fiberGroup->deficit += quantum;
+    if (QUEUE_NEXT(&fiberGroup->queueItem) == &activeFiberGroupQueue_) {
+      if (fiberGroup->deficit <= 0) {
+        fiberGroup->deficit = quantum;
       }
+    } else {
+      QUEUE_REMOVE(&fiberGroup->queueItem);
+      QUEUE_INSERT_TAIL(&activeFiberGroupQueue_, &fiberGroup->queueItem);
     }
   }
+  auto waiter = QUEUE_DATA(QUEUE_HEAD(&fiberGroup->readyFiberQueue), Waiter,
+                           queueItem);
+  QUEUE_REMOVE(&waiter->queueItem);
+  --readyFiberCount_;
+  ++fiberGroup->dispatchCount;
+  return waiter;
+}
+
+bool Scheduler::pollIsDue() const
+{
+  return dispatchCount_ - pollDispatchCount_ >= pollDispatchInterval_ ||
+         GetTime() - pollTime_ >= pollTimeInterval_;
+}
+
+void Scheduler::chargeCPUTime()
+{
+  uint64_t now = GetPreciseTime();
+  FiberGroup *fiberGroup = runningFiber_ != nullptr ? runningFiber_->group
+                                                    : stacklessGroup_;
+  if (fiberGroup != nullptr) {
+    uint64_t cpuTime = now - sliceStartTime_;
+    fiberGroup->cpuTime += cpuTime;
+    fiberGroup->deficit -= cpuTime;
+  }
+  sliceStartTime_ = now;
+}
+
+void Scheduler::recordDispatch(Waiter *waiter)
+{
+  dispatchTime_ = sliceStartTime_;
+  if (waiter->readyTime == 0) {
+    return;
+  }
+  uint64_t readyLag = (sliceStartTime_ - waiter->readyTime) / 1000;
+  waiter->readyTime = 0;
+  readyLag_ = readyLag_ - readyLag_ / 16 + readyLag / 16;
+  dispatchDelayHistogram_.record(readyLag);
+}
+
+void Scheduler::recordRunSlice()
+{
+  runSliceHistogram_.record((sliceStartTime_ - dispatchTime_) / 1000);
+}
+
+void Scheduler::chargeFiber(Fiber *fiber)
+{
+  recordRunSlice();
+  FiberStatistics *statistics = &fiber->statistics;
+  statistics->cpuTime += sliceStartTime_ - dispatchTime_;
+  statistics->readByteCount += ioByteCount_ - ioWrittenByteCount_;
+  statistics->writtenByteCount += ioWrittenByteCount_;
+  fiber->switchTime = sliceStartTime_;
+  if (fiber->context == nullptr && fiber->spawnSite != nullptr) {
+    fiber->spawnSite->recordFiberStatistics(*statistics);
+  }
+}
+
+void Scheduler::PreemptionSignalHandler(int signalNumber,
+                                        siginfo_t *signalInfo, void *context)
+{
+  static_cast<void>(signalNumber);
+  static_cast<void>(context);
+  auto scheduler = static_cast<Scheduler *>(signalInfo->si_value.sival_ptr);
+  if (scheduler != nullptr) {
+    int errorNumber = errno;
+    scheduler->handlePreemptionSignal();
+    errno = errorNumber;
+  }
+}
+
+void Scheduler::handlePreemptionSignal()
+{
+  if (runningFiber_ == nullptr || dispatchCount_ != preemptionDispatchCount_) {
+    preemptionDispatchCount_ = dispatchCount_;
+    return;
+  }
+  preemptionIsRequested_ = 1;
+  if (runningFiber_->asyncPreemptionIsAllowed && !isInRuntime_) {
+    sigset_t signalSet;
+    sigemptyset(&signalSet);
+    sigaddset(&signalSet, TARA_PREEMPTION_SIGNAL);
+    xthread_sigmask(SIG_UNBLOCK, &signalSet, nullptr);
+    preemptCurrentFiber();
+  }
+}
+
+void Scheduler::switchToFiber(Fiber *fiber)
+{
+  assert(runningFiber_ != nullptr);
+  assert(fiber != nullptr);
+  jmp_buf context;
+  if (setjmp(context) != 0) {
+    return;
+  }
+  runningFiber_->context = &context;
+  runningFiber_->status = 1;
+  insertReadyWaiterHead(runningFiber_);
+  ++fiber->group->dispatchCount;
+  executeFiber(fiber);
 }
 
 void Scheduler::execute()
 {
+  chargeCPUTime();
+  if (runningFiber_ != nullptr) {
+    chargeFiber(runningFiber_);
+  }
   runningFiber_ = nullptr;
+  preemptionIsRequested_ = 0;
   assert(context_ != nullptr);
   assert(status_ != 0);
   longjmp(*context_, status_);
 }
 
+void Scheduler::executeNextFiber()
+{
+  if (readyFiberCount_ == 0 || pollIsDue()) {
+    execute();
+  }
+  Waiter *waiter = removeReadyWaiter();
+  if (waiter->resume != nullptr) {
+    stacklessWaiter_ = waiter;
+    execute();
+  }
+  executeFiber(static_cast<Fiber *>(waiter));
+}
+
 void Scheduler::executeFiber(Fiber *fiber)
 {
   assert(fiber != nullptr);
+  chargeCPUTime();
+  if (runningFiber_ != nullptr) {
+    chargeFiber(runningFiber_);
+  }
+  isInRuntime_ = 1;
+  SignalFence();
   runningFiber_ = fiber;
+  recordDispatch(fiber);
+  ++fiber->statistics.switchCount;
+  if (fiber->switchTime != 0) {
+    fiber->statistics.waitTime += sliceStartTime_ - fiber->switchTime;
+  }
+  ++dispatchCount_;
+  beat();
+  preemptionIsRequested_ = 0;
+  ioOperationCount_ = 0;
+  ioByteCount_ = 0;
+  ioWrittenByteCount_ = 0;
   if (fiber->context == nullptr) {
     RunFiber(FiberStart, this, fiber->stack, fiber->stackSize);
   }
@@ -167,8 +986,10 @@ void Scheduler::executeFiber(Fiber *fiber)
 
 void Scheduler::yieldCurrentFiber()
 {
+  RuntimeSection runtimeSection(this);
   assert(runningFiber_ != nullptr);
-  if (QUEUE_EMPTY(&readyFiberQueue_)) {
+  if (readyFiberCount_ == 0) {
+    preemptCurrentFiber();
     return;
   }
   jmp_buf context;
@@ -177,14 +998,13 @@ void Scheduler::yieldCurrentFiber()
   }
   runningFiber_->context = &context;
   runningFiber_->status = 1;
-  QUEUE_INSERT_TAIL(&readyFiberQueue_, &runningFiber_->queueItem);
-  auto fiber = QUEUE_DATA(QUEUE_HEAD(&readyFiberQueue_), Fiber, queueItem);
-  QUEUE_REMOVE(&fiber->queueItem);
-  executeFiber(fiber);
+  insertReadyWaiterTail(runningFiber_);
+  executeNextFiber();
 }
 
-void Scheduler::sleepCurrentFiber(int duration)
+void Scheduler::preemptCurrentFiber()
 {
+  RuntimeSection runtimeSection(this);
   assert(runningFiber_ != nullptr);
   jmp_buf context;
   if (setjmp(context) != 0) {
@@ -192,13 +1012,22 @@ void Scheduler::sleepCurrentFiber(int duration)
   }
   runningFiber_->context = &context;
   runningFiber_->status = 1;
-  timer_.addItem(&runningFiber_->timerItem, duration);
-  if (QUEUE_EMPTY(&readyFiberQueue_)) {
-    execute();
+  insertReadyWaiterTail(runningFiber_);
+  execute();
+}
+
+void Scheduler::sleepCurrentFiber(int duration)
+{
+  RuntimeSection runtimeSection(this);
+  assert(runningFiber_ != nullptr);
+  jmp_buf context;
+  if (setjmp(context) != 0) {
+    return;
   }
-  auto fiber = QUEUE_DATA(QUEUE_HEAD(&readyFiberQueue_), Fiber, queueItem);
-  QUEUE_REMOVE(&fiber->queueItem);
-  executeFiber(fiber);
+  runningFiber_->context = &context;
+  runningFiber_->status = 1;
+  sleepWaiter(runningFiber_, duration);
+  executeNextFiber();
 }
 
 void Scheduler::exitCurrentFiber() const
@@ -207,43 +1036,105 @@ void Scheduler::exitCurrentFiber() const
   throw UnwindStack();
 }
 
+bool Scheduler::exceptionExitsFiber(const std::exception_ptr &exception) const
+{
+  if (exception == nullptr) {
+    return false;
+  }
+  try {
+    std::rethrow_exception(exception);
+  } catch (const UnwindStack &) {
+    return true;
+  } catch (...) {
+    return false;
+  }
+}
+
+void Scheduler::quickExitCurrentFiber()
+{
+  assert(runningFiber_ != nullptr);
+  if (runningFiber_->quickExitIsForbidden) {
+    exitCurrentFiber();
+  }
+  killCurrentFiber();
+}
+
+void Scheduler::forbidQuickExit()
+{
+  assert(runningFiber_ != nullptr);
+  runningFiber_->quickExitIsForbidden = true;
+}
+
 void Scheduler::killCurrentFiber()
 {
+  RuntimeSection runtimeSection(this);
   assert(runningFiber_ != nullptr);
+  const_cast<Coroutine &>(runningFiber_->coroutine) = nullptr;
   runningFiber_->context = nullptr;
   runningFiber_->status = 0;
-  QUEUE_INSERT_TAIL(&deadFiberQueue_, &runningFiber_->queueItem);
-  if (QUEUE_EMPTY(&readyFiberQueue_)) {
-    execute();
+  runningFiber_->arena.reset();
+  SpawnSite *spawnSite = runningFiber_->spawnSite;
+  if (runningFiber_->stackIsPainted && spawnSite == nullptr) {
+    runningFiber_->stackIsPainted = false;
   }
-  auto fiber = QUEUE_DATA(QUEUE_HEAD(&readyFiberQueue_), Fiber, queueItem);
-  QUEUE_REMOVE(&fiber->queueItem);
-  executeFiber(fiber);
+  if (runningFiber_->stackIsPainted) {
+    unsigned char *stackHighWaterMark = FindStackHighWaterMark(runningFiber_);
+    size_t stackUsage = runningFiber_->stack + runningFiber_->stackSize -
+                        stackHighWaterMark;
+    bool stackUsageIsMax = stackUsage > spawnSite->maxStackUsage;
+    spawnSite->recordStackUsage(stackUsage);
+    unsigned int sampleCount = spawnSite->stackUsageSampleCount;
+    if (sampleCount >= TARA_STACK_AUTO_SIZING_SAMPLE_COUNT &&
+        (stackUsageIsMax || (sampleCount & (sampleCount - 1)) == 0)) {
+      spawnSite->stackClass = ChooseStackClass(spawnSite);
+    }
+    auto stackEnd = static_cast<unsigned char *>(__builtin_frame_address(0)) -
+                    TARA_STACK_RED_ZONE_SIZE;
+    PaintStack(stackHighWaterMark, stackEnd);
+  }
+  FiberCache *fiberCache = &fiberCaches_[runningFiber_->stackClass];
+  QUEUE_INSERT_TAIL(&fiberCache->deadFiberQueue, &runningFiber_->queueItem);
+  ++fiberCache->deadFiberCount;
+  ++deadFiberCount_;
+  executeNextFiber();
+}
+
+void Scheduler::watchIO(int fd, bool isDaemon)
+{
+  RuntimeSection runtimeSection(this);
+  ioPoll_.createWatcher(fd, isDaemon);
 }
 
 void Scheduler::unwatchIO(int fd)
 {
+  RuntimeSection runtimeSection(this);
   QUEUE fiberQueue;
   QUEUE_INIT(&fiberQueue);
   ioPoll_.removeEventAwaiters(fd, &fiberQueue);
   ioPoll_.destroyWatcher(fd);
-  QUEUE *q;
-  QUEUE_FOREACH(q, &fiberQueue) {
-    auto fiber = QUEUE_DATA(q, Fiber, queueItem);
-    timer_.removeItem(&fiber->timerItem);
-    fiber->status = -EBADF;
-  }
-  if (!QUEUE_EMPTY(&fiberQueue)) {
-    QUEUE_ADD(&readyFiberQueue_, &fiberQueue);
+  while (!QUEUE_EMPTY(&fiberQueue)) {
+    auto waiter = QUEUE_DATA(QUEUE_HEAD(&fiberQueue), Waiter, queueItem);
+    QUEUE_REMOVE(&waiter->queueItem);
+    timer_.removeItem(&waiter->timerItem);
+    waiter->fd = -1;
+    waiter->status = -EBADF;
+    insertWokenWaiter(waiter);
   }
 }
 
 int Scheduler::awaitIOEvent(int fd, IOEvent ioEvent, int timeout)
 {
+  RuntimeSection runtimeSection(this);
   assert(runningFiber_ != nullptr);
+  chargeCPUTime();
+  uint64_t waitStartTime = sliceStartTime_;
   jmp_buf context;
   int status = setjmp(context);
   if (status != 0) {
+    Histogram *histogram = ioEvent == IOEvent::Readability
+                           ? &readabilityWaitHistogram_
+                           : &writabilityWaitHistogram_;
+    histogram->record((sliceStartTime_ - waitStartTime) / 1000);
     if (status < 0) {
       errno = -status;
       return -1;
@@ -252,62 +1143,94 @@ int Scheduler::awaitIOEvent(int fd, IOEvent ioEvent, int timeout)
   }
   runningFiber_->context = &context;
   runningFiber_->status = 1;
-  runningFiber_->fd = fd;
-  ioPoll_.addEventAwaiter(&runningFiber_->queueItem, fd, ioEvent);
-  timer_.addItem(&runningFiber_->timerItem, timeout);
-  if (QUEUE_EMPTY(&readyFiberQueue_)) {
-    execute();
-  }
-  auto fiber = QUEUE_DATA(QUEUE_HEAD(&readyFiberQueue_), Fiber, queueItem);
-  QUEUE_REMOVE(&fiber->queueItem);
-  executeFiber(fiber);
+  watchIOEvent(runningFiber_, fd, ioEvent, timeout);
+  executeNextFiber();
 }
 
 void Scheduler::suspendCurrentFiber()
 {
+  RuntimeSection runtimeSection(this);
   assert(runningFiber_ != nullptr);
   jmp_buf context;
   if (setjmp(context) != 0) {
+    --suspendedFiberCount_;
     return;
   }
   runningFiber_->context = &context;
   runningFiber_->status = 1;
-  if (QUEUE_EMPTY(&readyFiberQueue_)) {
-    execute();
-  }
-  auto fiber = QUEUE_DATA(QUEUE_HEAD(&readyFiberQueue_), Fiber, queueItem);
-  QUEUE_REMOVE(&fiber->queueItem);
-  executeFiber(fiber);
+  ++suspendedFiberCount_;
+  executeNextFiber();
 }
 
 void Scheduler::resumeFiber(Fiber *fiber)
 {
-  assert(runningFiber_ != nullptr);
+  RuntimeSection runtimeSection(this);
   assert(fiber != nullptr);
-  assert(fiber != runningFiber_);
-  QUEUE_INSERT_TAIL(&readyFiberQueue_, &fiber->queueItem);
+  resumeWaiter(fiber);
 }
 
-Fiber::Fiber(const Coroutine &coroutine, unsigned char *stack, size_t stackSize)
-  : coroutine(coroutine), stack(stack), stackSize(stackSize),
-#ifdef USE_VALGRIND
-    stackID(VALGRIND_STACK_REGISTER(stack, stack + stackSize)),
-#endif
-    context(nullptr), status(0), fd(-1)
+void Scheduler::submitTask(Waiter *waiter, const Task *task)
 {
-  assert(this->coroutine != nullptr);
-  assert(this->stack != nullptr);
-  assert(this->stackSize != 0);
+  RuntimeSection runtimeSection(this);
+  prepareWaiter(waiter);
+  async_.submitTasks(waiter, task, 1);
+}
+
+void Scheduler::awaitTask(const Task *task)
+{
+  RuntimeSection runtimeSection(this);
+  assert(runningFiber_ != nullptr);
+  async_.submitTasks(runningFiber_, task, 1);
+  suspendCurrentFiber();
+}
+
+void Scheduler::readyWaiter(Waiter *waiter)
+{
+  RuntimeSection runtimeSection(this);
+  assert(waiter != nullptr);
+  prepareWaiter(waiter);
+  insertWokenWaiter(waiter);
+}
+
+void Scheduler::sleepWaiter(Waiter *waiter, int duration)
+{
+  RuntimeSection runtimeSection(this);
+  assert(waiter != nullptr);
+  prepareWaiter(waiter);
+  timer_.addItem(&waiter->timerItem, duration);
+}
+
+void Scheduler::watchIOEvent(Waiter *waiter, int fd, IOEvent ioEvent,
+                             int timeout)
+{
+  RuntimeSection runtimeSection(this);
+  assert(waiter != nullptr);
+  prepareWaiter(waiter);
+  waiter->fd = fd;
+  ioPoll_.addEventAwaiter(&waiter->queueItem, fd, ioEvent);
+  timer_.addItem(&waiter->timerItem, timeout);
+}
+
+void Scheduler::resumeWaiter(Waiter *waiter)
+{
+  RuntimeSection runtimeSection(this);
+  assert(waiter != nullptr);
+  assert(waiter != runningFiber_);
+  insertWokenWaiter(waiter);
 }
 
-Fiber::Fiber(Coroutine &&coroutine, unsigned char *stack, size_t stackSize)
-  : coroutine(std::move(coroutine)), stack(stack), stackSize(stackSize),
+Fiber::Fiber(unsigned int stackClass, unsigned char *stack, size_t stackSize,
+             MemoryPool *arenaPagePool)
+  : stackClass(stackClass), stack(stack), stackSize(stackSize),
 #ifdef USE_VALGRIND
     stackID(VALGRIND_STACK_REGISTER(stack, stack + stackSize)),
 #endif
-    context(nullptr), status(0), fd(-1)
+    context(nullptr), stackIsReleased(false), stackIsPainted(false),
+    spawnSite(nullptr), spawnSiteAddress(nullptr),
+    asyncPreemptionIsAllowed(false), quickExitIsForbidden(false),
+    switchTime(0),
+    statistics(), arena(arenaPagePool, TARA_ARENA_PAGE_SIZE)
 {
-  assert(this->coroutine != nullptr);
   assert(this->stack != nullptr);
   assert(this->stackSize != 0);
 }
@@ -321,52 +1244,175 @@ Fiber::~Fiber()
 
 namespace {
 
-Fiber *CreateFiber(const Coroutine &coroutine)
+Fiber *CreateFiber(unsigned int stackClass, MemoryPool *arenaPagePool)
 {
-  auto region = static_cast<unsigned char *>(malloc(TARA_REGION_SIZE));
-  if (region == nullptr) {
-    assert(TARA_REGION_SIZE != 0);
-    TARA_FATALITY_LOG("malloc failed");
-  }
-  auto fiber = reinterpret_cast<Fiber *>(region + TARA_REGION_SIZE) - 1;
+  size_t regionSize = TARA_MIN_REGION_SIZE << stackClass;
+  auto region = static_cast<unsigned char *>
+                (SchedulerPolicy::StackAllocator::AllocateRegion(regionSize));
+  auto fiber = reinterpret_cast<Fiber *>(region + regionSize) - 1;
   unsigned char *stack = region;
-  size_t stackSize = TARA_REGION_SIZE - sizeof *fiber;
-  static_cast<void>(new (fiber) Fiber(coroutine, stack, stackSize));
+  size_t stackSize = regionSize - sizeof *fiber;
+  static_cast<void>(new (fiber) Fiber(stackClass, stack, stackSize,
+                                      arenaPagePool));
   return fiber;
 }
 
-Fiber *CreateFiber(Coroutine &&coroutine)
+void DestroyFiber(Fiber *fiber)
+{
+  assert(fiber != nullptr);
+  size_t regionSize = TARA_MIN_REGION_SIZE << fiber->stackClass;
+  fiber->~Fiber();
+  auto region = reinterpret_cast<unsigned char *>(fiber + 1) - regionSize;
+  SchedulerPolicy::StackAllocator::FreeRegion(region, regionSize);
+}
+
+void ReleaseFiberStack(Fiber *fiber)
 {
-  auto region = static_cast<unsigned char *>(malloc(TARA_REGION_SIZE));
-  if (region == nullptr) {
-    assert(TARA_REGION_SIZE != 0);
-    TARA_FATALITY_LOG("malloc failed");
+  assert(fiber != nullptr);
+  static const uintptr_t pageSize = xsysconf(_SC_PAGE_SIZE);
+  uintptr_t stackBegin = (reinterpret_cast<uintptr_t>(fiber->stack) +
+                          pageSize - 1) & ~(pageSize - 1);
+  uintptr_t stackEnd = reinterpret_cast<uintptr_t>(fiber->stack +
+                                                   fiber->stackSize) &
+                       ~(pageSize - 1);
+  if (stackBegin < stackEnd) {
+    xmadvise(reinterpret_cast<void *>(stackBegin), stackEnd - stackBegin,
+             MADV_DONTNEED);
   }
-  auto fiber = reinterpret_cast<Fiber *>(region + TARA_REGION_SIZE) - 1;
-  unsigned char *stack = region;
-  size_t stackSize = TARA_REGION_SIZE - sizeof *fiber;
-  static_cast<void>(new (fiber) Fiber(std::move(coroutine), stack, stackSize));
-  return fiber;
 }
 
-void DestroyFiber(Fiber *fiber)
+void PaintStack(unsigned char *stack, unsigned char *stackEnd)
+{
+  auto word = reinterpret_cast<uint64_t *>(stack);
+  auto wordEnd = reinterpret_cast<uint64_t *>(stackEnd);
+  for (; word < wordEnd; ++word) {
+    *word = TARA_STACK_PAINT;
+  }
+}
+
+void PrefaultStack(unsigned char *stack, unsigned char *stackEnd)
+{
+  static const size_t pageSize = xsysconf(_SC_PAGE_SIZE);
+  volatile unsigned char *byte = stackEnd;
+  for (; byte > stack; byte -= pageSize) {
+    byte[-1] = 0;
+  }
+}
+
+unsigned char *FindStackHighWaterMark(const Fiber *fiber)
 {
   assert(fiber != nullptr);
-  fiber->~Fiber();
-  auto region = reinterpret_cast<unsigned char *>(fiber + 1) - TARA_REGION_SIZE;
-  free(region);
+  auto word = reinterpret_cast<const uint64_t *>(fiber->stack);
+  auto wordEnd = reinterpret_cast<const uint64_t *>(fiber->stack +
+                                                    fiber->stackSize);
+  while (word < wordEnd && *word == TARA_STACK_PAINT) {
+    ++word;
+  }
+  return reinterpret_cast<unsigned char *>(const_cast<uint64_t *>(word));
+}
+
+unsigned int ChooseStackClass(const SpawnSite *spawnSite)
+{
+  assert(spawnSite != nullptr);
+  size_t stackUsage = spawnSite->maxStackUsage;
+  stackUsage += stackUsage * TARA_STACK_AUTO_SIZING_MARGIN / 100 +
+                TARA_STACK_RED_ZONE_SIZE;
+  unsigned int stackClass = 0;
+  while (stackClass < TARA_MAX_STACK_CLASS &&
+         (TARA_MIN_REGION_SIZE << stackClass) - sizeof(Fiber) < stackUsage) {
+    ++stackClass;
+  }
+  return stackClass;
+}
+
+char *AppendString(char *buffer, char *bufferEnd, const char *string)
+{
+  while (buffer < bufferEnd && *string != '\0') {
+    *buffer++ = *string++;
+  }
+  return buffer;
+}
+
+char *AppendNumber(char *buffer, char *bufferEnd, unsigned long long number,
+                   unsigned int base)
+{
+  char digits[24];
+  char *digitsEnd = digits;
+  do {
+    *digitsEnd++ = "0123456789abcdef"[number % base];
+    number /= base;
+  } while (number != 0);
+  while (buffer < bufferEnd && digitsEnd > digits) {
+    *buffer++ = *--digitsEnd;
+  }
+  return buffer;
 }
 
 void FiberStart(Scheduler *scheduler) noexcept
 {
   assert(scheduler != nullptr);
   Fiber *fiber = scheduler->getCurrentFiber();
+  scheduler->leaveRuntime();
   try {
     fiber->coroutine();
   } catch (const UnwindStack &) {}
   scheduler->killCurrentFiber();
 }
 
+long xsysconf(int name)
+{
+  long result = sysconf(name);
+  if (result < 0) {
+    TARA_FATALITY_LOG("sysconf failed: ", Error(errno));
+  }
+  return result;
+}
+
+void xmadvise(void *addr, size_t length, int advice)
+{
+  if (madvise(addr, length, advice) < 0) {
+    TARA_FATALITY_LOG("madvise failed: ", Error(errno));
+  }
+}
+
+void xsigaction(int signum, const struct sigaction *act,
+                struct sigaction *oldact)
+{
+  if (sigaction(signum, act, oldact) < 0) {
+    TARA_FATALITY_LOG("sigaction failed: ", Error(errno));
+  }
+}
+
+void xthread_sigmask(int how, const sigset_t *set, sigset_t *oldset)
+{
+  int errorNumber = pthread_sigmask(how, set, oldset);
+  if (errorNumber != 0) {
+    TARA_FATALITY_LOG("pthread_sigmask failed: ", Error(errorNumber));
+  }
+}
+
+void xtimer_create(clockid_t clockid, sigevent *sevp, timer_t *timerid)
+{
+  if (timer_create(clockid, sevp, timerid) < 0) {
+    TARA_FATALITY_LOG("timer_create failed: ", Error(errno));
+  }
+}
+
+void xtimer_settime(timer_t timerid, int flags, const itimerspec *new_value,
+                    itimerspec *old_value)
+{
+  if (timer_settime(timerid, flags, new_value, old_value) < 0) {
+    TARA_FATALITY_LOG("timer_settime failed: ", Error(errno));
+  }
+}
+
+void xtimer_delete(timer_t timerid)
+{
+  if (timer_delete(timerid) < 0) {
+    TARA_FATALITY_LOG("timer_delete failed: ", Error(errno));
+  }
+}
+
 } // namespace
 
 } // namespace Tara
@@ -2,18 +2,72 @@
 
 #include <assert.h>
 #include <setjmp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#
+#include <exception>
+#include <unordered_map>
+#include <vector>
 #
 #include "libuv/queue.h"
 #
 #include "Async.hxx"
+#include "Atomic.hxx"
 #include "Coroutine.hxx"
-#include "IOPoll.hxx"
-#include "Timer.hxx"
+#include "Histogram.hxx"
+#include "IOEvent.hxx"
+#include "MemoryPool.hxx"
+#include "ObjectPool.hxx"
+#include "SchedulerPolicy.hxx"
+#include "SpawnSite.hxx"
+#include "TimerItem.hxx"
 
 namespace Tara {
 
+class FiberArena;
 struct Fiber;
-enum class IOEvent;
+struct FiberGroup;
+struct FiberGroupStatistics;
+struct FiberStatistics;
+struct SchedulerHistograms;
+struct SchedulerMetrics;
+struct SpawnSiteStatistics;
+
+struct Waiter
+{
+  QUEUE queueItem;
+  TimerItem timerItem;
+  int status;
+  int fd;
+  FiberGroup *group;
+  uint64_t readyTime;
+  void (*resume)(Waiter *waiter);
+
+  Waiter()
+    : status(0), fd(-1), group(nullptr), readyTime(0), resume(nullptr)
+  {}
+};
+
+struct FiberCache final
+{
+  QUEUE deadFiberQueue;
+  unsigned int deadFiberCount;
+  unsigned int minDeadFiberCount;
+  unsigned int reservedFiberCount;
+};
+
+struct FiberGroup final
+{
+  QUEUE queueItem;
+  QUEUE readyFiberQueue;
+  int id;
+  unsigned int weight;
+  bool isActive;
+  int64_t deficit;
+  unsigned long dispatchCount;
+  uint64_t cpuTime;
+};
 
 class Scheduler final
 {
@@ -22,38 +76,200 @@ class Scheduler final
 
 public:
   Scheduler();
+  ~Scheduler();
 
   Fiber *getCurrentFiber() const { assert(runningFiber_ != nullptr);
                                    return runningFiber_; }
+  bool fiberIsRunning() const { return runningFiber_ != nullptr; }
+  unsigned long getHeartbeat() const
+  { return Load(heartbeat_, MemoryOrder::Relaxed); }
+  bool isIdle() const { return Load(isIdle_, MemoryOrder::Relaxed); }
   bool ioIsWatched(int fd) const { return ioPoll_.watcherExists(fd); }
-  void watchIO(int fd) { ioPoll_.createWatcher(fd); }
-  void awaitTask(const Task *task) { async_.awaitTask(task); }
+  bool ioIsAwaited(int fd) const { return ioPoll_.eventAwaitersExist(fd); }
+  void leaveRuntime() { SignalFence(); isInRuntime_ = 0; }
+
+  void setFiberCacheCapacity(unsigned int capacity)
+  { fiberCacheCapacity_ = capacity; }
+  void setFiberStackReleasing(bool enabled)
+  { fiberStackReleasing_ = enabled; }
+  void setStackProfiling(bool enabled) { stackProfiling_ = enabled; }
+  void setFiberAccounting(bool enabled) { fiberAccounting_ = enabled; }
+  void setVirtualClock(bool enabled) { timer_.setVirtualClock(enabled); }
+  uint64_t getTime() const { return timer_.getTime(); }
+  bool isOverloaded() const { return readyLag_ >= overloadLag_ ||
+                                     readyFiberCount_ >= overloadReadyCount_; }
+  void addStacklessTask() { ++stacklessTaskCount_; }
+  void removeStacklessTask() { --stacklessTaskCount_; }
+
+  void checkpoint() { if (preemptionIsRequested_) { preemptCurrentFiber(); } }
+  void chargeIO(IOEvent ioEvent, size_t byteCount);
 
-  void callCoroutine(const Coroutine &coroutine);
-  void callCoroutine(Coroutine &&coroutine);
-  void run();
+  FiberArena &getCurrentFiberArena() const;
+  void setIOBudget(unsigned int operationCount, size_t byteCount);
+  void setPollInterval(unsigned int dispatchCount, int duration);
+  void setOverloadThreshold(int lag, unsigned int readyFiberCount);
+  int calculateBackoff(uint64_t deadline) const;
+  int calculateTimeout(uint64_t deadline) const;
+  void prewarm(unsigned int fiberCount, StackSize stackSize,
+               unsigned int fdCount);
+  void enablePreemption(int timeSlice);
+  void disablePreemption();
+  void allowAsyncPreemption(bool allowed);
+  int createFiberGroup(unsigned int weight);
+  int setFiberGroupWeight(int fiberGroupID, unsigned int weight);
+  int joinFiberGroup(int fiberGroupID);
+  int getCurrentFiberGroup() const;
+  int getFiberGroupStatistics(int fiberGroupID,
+                              FiberGroupStatistics *statistics) const;
+
+  void callCoroutine(const Coroutine &coroutine,
+                     StackSize stackSize = StackSize::Medium,
+                     const void *spawnSiteAddress = nullptr);
+  void callCoroutine(Coroutine &&coroutine,
+                     StackSize stackSize = StackSize::Medium,
+                     const void *spawnSiteAddress = nullptr);
+  void callCoroutineNow(const Coroutine &coroutine,
+                        StackSize stackSize = StackSize::Medium,
+                        const void *spawnSiteAddress = nullptr);
+  void callCoroutineNow(Coroutine &&coroutine,
+                        StackSize stackSize = StackSize::Medium,
+                        const void *spawnSiteAddress = nullptr);
+  void reportStackUsage() const;
+  void getFiberStatistics(FiberStatistics *statistics);
+  unsigned int getSpawnSiteStatistics(SpawnSiteStatistics *statisticsList,
+                                      unsigned int maxCount) const;
+  void reportFiberAccounting() const;
+  void reportStall() const;
+  void getMetrics(SchedulerMetrics *metrics) const;
+  void getHistograms(SchedulerHistograms *histograms) const;
+  int getPollFD() { ioPoll_.flushWatchers(); return ioPoll_.getFD(); }
+  int getPollTimeout() { return calculateTimeout(); }
+  void prepareWatchdog();
+  bool runOnce(int timeout);
+  void run() { while (runOnce(-1)); }
   void yieldCurrentFiber();
+  void preemptCurrentFiber();
   void sleepCurrentFiber(int duration);
   [[noreturn]] void exitCurrentFiber() const;
+  bool exceptionExitsFiber(const std::exception_ptr &exception) const;
   [[noreturn]] void killCurrentFiber();
+  [[noreturn]] void quickExitCurrentFiber();
+  void forbidQuickExit();
+  void watchIO(int fd, bool isDaemon = false);
   void unwatchIO(int fd);
   int awaitIOEvent(int fd, IOEvent ioEvent, int timeout);
   void suspendCurrentFiber();
   void resumeFiber(Fiber *fiber);
+  void submitTask(Waiter *waiter, const Task *task);
+  void awaitTask(const Task *task);
+  void readyWaiter(Waiter *waiter);
+  void sleepWaiter(Waiter *waiter, int duration);
+  void watchIOEvent(Waiter *waiter, int fd, IOEvent ioEvent, int timeout);
+  void resumeWaiter(Waiter *waiter);
 
 private:
+  class RuntimeSection;
+
+  static void PreemptionSignalHandler(int signalNumber, siginfo_t *signalInfo,
+                                      void *context);
+
   unsigned int fiberCount_;
+  unsigned int deadFiberCount_;
+  unsigned int fiberCacheCapacity_;
+  bool fiberStackReleasing_;
+  uint64_t fiberCacheTrimTime_;
+  FiberCache fiberCaches_[8];
+  unsigned long createdFiberCount_;
+  unsigned long recycledFiberCount_;
+  unsigned long destroyedFiberCount_;
+  bool stackProfiling_;
+  bool fiberAccounting_;
+  std::unordered_map<const void *, SpawnSite> spawnSites_;
   jmp_buf *context_;
   int status_;
   Fiber *runningFiber_;
-  QUEUE readyFiberQueue_;
-  QUEUE deadFiberQueue_;
-  IOPoll ioPoll_;
-  Timer timer_;
+  Waiter *stacklessWaiter_;
+  FiberGroup *stacklessGroup_;
+  unsigned int stacklessTaskCount_;
+  unsigned long dispatchCount_;
+  unsigned long heartbeat_;
+  bool isIdle_;
+  bool watchdogIsPrepared_;
+  bool preemptionIsEnabled_;
+  timer_t preemptionTimer_;
+  unsigned long preemptionDispatchCount_;
+  volatile sig_atomic_t preemptionIsRequested_;
+  mutable volatile sig_atomic_t isInRuntime_;
+  unsigned int suspendedFiberCount_;
+  unsigned int ioOperationBudget_;
+  size_t ioByteBudget_;
+  unsigned int ioOperationCount_;
+  size_t ioByteCount_;
+  size_t ioWrittenByteCount_;
+  unsigned long pollDispatchInterval_;
+  uint64_t pollTimeInterval_;
+  unsigned long pollDispatchCount_;
+  uint64_t pollTime_;
+  std::vector<FiberGroup *> fiberGroups_;
+  QUEUE activeFiberGroupQueue_;
+  unsigned int readyFiberCount_;
+  uint64_t sliceStartTime_;
+  uint64_t dispatchTime_;
+  uint64_t readyLag_;
+  uint64_t overloadLag_;
+  unsigned int overloadReadyCount_;
+  Histogram readabilityWaitHistogram_;
+  Histogram writabilityWaitHistogram_;
+  Histogram runSliceHistogram_;
+  Histogram dispatchDelayHistogram_;
+  ObjectPool<FiberGroup, 16> fiberGroupPool_;
+  MemoryPool arenaPagePool_;
+  SchedulerPolicy::IOPollBackend ioPoll_;
+  SchedulerPolicy::TimerBackend timer_;
   Async async_;
 
+  Fiber *allocateFiber(StackSize stackSize, const void *spawnSiteAddress);
+  void destroyDeadFibers(FiberCache *fiberCache, unsigned int deadFiberCount);
+  void trimFiberCaches();
+  int calculateTimeout();
+  void prepareWaiter(Waiter *waiter) const;
+  void insertReadyWaiterHead(Waiter *waiter);
+  void insertReadyWaiterTail(Waiter *waiter);
+  void insertWokenWaiter(Waiter *waiter);
+  Waiter *removeReadyWaiter();
+  bool pollIsDue() const;
+  void chargeCPUTime();
+  void recordDispatch(Waiter *waiter);
+  void recordRunSlice();
+  void chargeFiber(Fiber *fiber);
+  void beat() { Store(heartbeat_, heartbeat_ + 1, MemoryOrder::Relaxed); }
+  void switchToFiber(Fiber *fiber);
+  void handlePreemptionSignal();
   [[noreturn]] void execute();
+  [[noreturn]] void executeNextFiber();
   [[noreturn]] void executeFiber(Fiber *fiber);
 };
 
+inline void Scheduler::insertWokenWaiter(Waiter *waiter)
+{
+  if (SchedulerPolicy::ReadyQueueOrder == ReadyQueueDiscipline::LIFO) {
+    insertReadyWaiterHead(waiter);
+  } else {
+    insertReadyWaiterTail(waiter);
+  }
+}
+
+inline void Scheduler::chargeIO(IOEvent ioEvent, size_t byteCount)
+{
+  ++ioOperationCount_;
+  ioByteCount_ += byteCount;
+  if (ioEvent == IOEvent::Writability) {
+    ioWrittenByteCount_ += byteCount;
+  }
+  if (ioOperationCount_ >= ioOperationBudget_ ||
+      ioByteCount_ >= ioByteBudget_) {
+    preemptCurrentFiber();
+  }
+}
+
 } // namespace Tara
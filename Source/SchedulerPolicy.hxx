@@ -0,0 +1,92 @@
+#pragma once
+
+#include <sys/mman.h>
+#
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#
+#include "Error.hxx"
+#include "IOPoll.hxx"
+#include "Log.hxx"
+#include "Timer.hxx"
+
+namespace Tara {
+
+enum class ReadyQueueDiscipline
+{
+  FIFO,
+  LIFO,
+};
+
+struct MallocStackAllocator final
+{
+  static void *AllocateRegion(size_t regionSize);
+  static void FreeRegion(void *region, size_t regionSize);
+};
+
+struct MmapStackAllocator final
+{
+  static void *AllocateRegion(size_t regionSize);
+  static void FreeRegion(void *region, size_t regionSize);
+};
+
+template<typename IO_POLL, typename TIMER,
+         ReadyQueueDiscipline READY_QUEUE_DISCIPLINE,
+         typename STACK_ALLOCATOR>
+struct BasicSchedulerPolicy final
+{
+  typedef IO_POLL IOPollBackend;
+  typedef TIMER TimerBackend;
+  typedef STACK_ALLOCATOR StackAllocator;
+
+  static constexpr ReadyQueueDiscipline ReadyQueueOrder =
+    READY_QUEUE_DISCIPLINE;
+};
+
+typedef BasicSchedulerPolicy<IOPoll, Timer, ReadyQueueDiscipline::FIFO,
+                             MallocStackAllocator> DefaultSchedulerPolicy;
+typedef BasicSchedulerPolicy<IOPoll, Timer, ReadyQueueDiscipline::LIFO,
+                             MallocStackAllocator> LIFOSchedulerPolicy;
+typedef BasicSchedulerPolicy<IOPoll, Timer, ReadyQueueDiscipline::FIFO,
+                             MmapStackAllocator> MmapSchedulerPolicy;
+
+#ifndef TARA_SCHEDULER_POLICY
+#define TARA_SCHEDULER_POLICY DefaultSchedulerPolicy
+#endif
+
+typedef TARA_SCHEDULER_POLICY SchedulerPolicy;
+
+inline void *MallocStackAllocator::AllocateRegion(size_t regionSize)
+{
+  void *region = malloc(regionSize);
+  if (region == nullptr) {
+    TARA_FATALITY_LOG("malloc failed");
+  }
+  return region;
+}
+
+inline void MallocStackAllocator::FreeRegion(void *region, size_t regionSize)
+{
+  static_cast<void>(regionSize);
+  free(region);
+}
+
+inline void *MmapStackAllocator::AllocateRegion(size_t regionSize)
+{
+  void *region = mmap(nullptr, regionSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (region == MAP_FAILED) {
+    TARA_FATALITY_LOG("mmap failed: ", Error(errno));
+  }
+  return region;
+}
+
+inline void MmapStackAllocator::FreeRegion(void *region, size_t regionSize)
+{
+  if (munmap(region, regionSize) < 0) {
+    TARA_FATALITY_LOG("munmap failed: ", Error(errno));
+  }
+}
+
+} // namespace Tara
@@ -0,0 +1,522 @@
+#include "Shard.hxx"
+
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#
+#include <exception>
+#include <new>
+#include <utility>
+#include <vector>
+#
+#include "Atomic.hxx"
+#include "Error.hxx"
+#include "Log.hxx"
+#include "Runtime.hxx"
+#include "Scheduler.hxx"
+
+#define TARA_CORE_RING_CAPACITY 1024
+#define TARA_CACHE_LINE_SIZE 64
+
+namespace Tara {
+
+extern thread_local Scheduler *TheScheduler;
+
+struct FutureState final
+{
+  bool isReady;
+  int errorNumber;
+  std::exception_ptr exception;
+  Fiber *waitingFiber;
+
+  FutureState() : isReady(false), errorNumber(0), waitingFiber(nullptr) {}
+};
+
+namespace {
+
+struct CoreRing final
+{
+  alignas(TARA_CACHE_LINE_SIZE) unsigned int head;
+  alignas(TARA_CACHE_LINE_SIZE) unsigned int tail;
+  alignas(TARA_CACHE_LINE_SIZE) Coroutine *messages[TARA_CORE_RING_CAPACITY];
+
+  CoreRing() : head(0), tail(0) {}
+};
+
+struct alignas(TARA_CACHE_LINE_SIZE) Core final
+{
+  int id;
+  int cpu;
+  int doorbellFD;
+  std::vector<CoreRing *> incomingRings;
+  std::vector<char> pendingDoorbells;
+  bool doorbellFlushIsScheduled;
+  bool isStopped;
+  unsigned int pendingFutureCount;
+  unsigned int pendingRequestCount;
+};
+
+struct Request final
+{
+  Coroutine coroutine;
+  std::shared_ptr<FutureState> futureState;
+  int sourceCoreID;
+
+  void operator()();
+  void complete(int errorNumber, const std::exception_ptr &exception);
+};
+
+Core *Cores;
+int CoreCount;
+pthread_barrier_t CoreBarrier;
+thread_local Core *CurrentCore;
+
+void *CoreStart(void *argument);
+void RunCore(Core *core, Coroutine &&coroutine);
+void ServeCore(Core *core);
+void StopCores();
+bool CoreIsDone(const Core *core);
+std::exception_ptr CallInternalCoroutine(const Coroutine &coroutine);
+void PostMessage(int coreID, Coroutine &&coroutine);
+void FlushDoorbells();
+void RingDoorbell(const Core *core);
+CoreRing *CreateCoreRing();
+void DestroyCoreRing(CoreRing *ring);
+bool PushMessage(CoreRing *ring, Coroutine *message);
+Coroutine *PopMessage(CoreRing *ring);
+
+int xeventfd(unsigned int initval, int flags);
+void xclose(int fd);
+void xsched_getaffinity(pid_t pid, size_t cpusetsize, cpu_set_t *mask);
+void xthread_setaffinity_np(pthread_t thread, size_t cpusetsize,
+                            const cpu_set_t *cpuset);
+void xthread_barrier_init(pthread_barrier_t *barrier,
+                          const pthread_barrierattr_t *attr,
+                          unsigned int count);
+void xthread_barrier_destroy(pthread_barrier_t *barrier);
+void xthread_barrier_wait(pthread_barrier_t *barrier);
+void xthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                    void *(*start_routine)(void *), void *arg);
+void xthread_join(pthread_t thread, void **retval);
+
+} // namespace
+
+bool Future::isReady() const
+{
+  return state_ != nullptr && state_->isReady;
+}
+
+int Future::wait()
+{
+  if (state_ == nullptr) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (TheScheduler == nullptr) {
+    TARA_FATALITY_LOG("No scheduler");
+  }
+  while (!state_->isReady) {
+    state_->waitingFiber = TheScheduler->getCurrentFiber();
+    TheScheduler->suspendCurrentFiber();
+  }
+  if (state_->exception != nullptr) {
+    std::rethrow_exception(state_->exception);
+  }
+  if (state_->errorNumber != 0) {
+    errno = state_->errorNumber;
+    return -1;
+  }
+  return 0;
+}
+
+void RunCores(int coreCount, Coroutine &&coroutine)
+{
+  assert(coreCount >= 0);
+  if (Cores != nullptr) {
+    TARA_FATALITY_LOG("Cores already running");
+  }
+  cpu_set_t cpuSet;
+  xsched_getaffinity(0, sizeof cpuSet, &cpuSet);
+  std::vector<int> cpus;
+  for (int i = 0; i < CPU_SETSIZE; ++i) {
+    if (CPU_ISSET(i, &cpuSet)) {
+      cpus.push_back(i);
+    }
+  }
+  if (coreCount == 0) {
+    coreCount = cpus.size();
+  }
+  std::vector<Core> cores(coreCount);
+  for (int i = 0; i < coreCount; ++i) {
+    Core *core = &cores[i];
+    core->id = i;
+    core->cpu = coreCount == 1 ? -1 : cpus[i % cpus.size()];
+    core->doorbellFD = xeventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    core->pendingDoorbells.resize(coreCount, false);
+    core->doorbellFlushIsScheduled = false;
+    core->isStopped = false;
+    core->pendingFutureCount = 0;
+    core->pendingRequestCount = 0;
+  }
+  Cores = cores.data();
+  CoreCount = coreCount;
+  xthread_barrier_init(&CoreBarrier, nullptr, coreCount);
+  std::vector<pthread_t> threads(coreCount - 1);
+  for (int i = 1; i < coreCount; ++i) {
+    xthread_create(&threads[i - 1], nullptr, CoreStart, &cores[i]);
+  }
+  RunCore(&cores[0], std::move(coroutine));
+  for (pthread_t thread : threads) {
+    xthread_join(thread, nullptr);
+  }
+  xthread_barrier_destroy(&CoreBarrier);
+  for (Core &core : cores) {
+    for (CoreRing *ring : core.incomingRings) {
+      Coroutine *message;
+      while ((message = PopMessage(ring)) != nullptr) {
+        delete message;
+      }
+      DestroyCoreRing(ring);
+    }
+    xclose(core.doorbellFD);
+  }
+  Cores = nullptr;
+  CoreCount = 0;
+}
+
+int GetCoreCount()
+{
+  return CoreCount;
+}
+
+int GetCurrentCore()
+{
+  return CurrentCore == nullptr ? -1 : CurrentCore->id;
+}
+
+Future SubmitTo(int core, const Coroutine &coroutine)
+{
+  return SubmitTo(core, Coroutine(coroutine));
+}
+
+Future SubmitTo(int core, Coroutine &&coroutine)
+{
+  if (CurrentCore == nullptr || core < 0 || core >= CoreCount ||
+      coroutine == nullptr) {
+    errno = EINVAL;
+    return Future();
+  }
+  Core *targetCore = &Cores[core];
+  FetchAdd(targetCore->pendingRequestCount, 1u);
+  if (Load(targetCore->isStopped)) {
+    FetchSub(targetCore->pendingRequestCount, 1u);
+    errno = ESHUTDOWN;
+    return Future();
+  }
+  auto futureState = std::make_shared<FutureState>();
+  ++CurrentCore->pendingFutureCount;
+  PostMessage(core, Request{std::move(coroutine), futureState,
+                            CurrentCore->id});
+  return Future(futureState);
+}
+
+namespace {
+
+void Request::operator()()
+{
+  if (Load(CurrentCore->isStopped, MemoryOrder::Relaxed)) {
+    complete(ESHUTDOWN, nullptr);
+    return;
+  }
+  std::exception_ptr exception = CallInternalCoroutine(coroutine);
+  if (TheScheduler->exceptionExitsFiber(exception)) {
+    complete(0, nullptr);
+    std::rethrow_exception(exception);
+  }
+  complete(0, exception);
+}
+
+void Request::complete(int errorNumber, const std::exception_ptr &exception)
+{
+  std::shared_ptr<FutureState> futureState = std::move(this->futureState);
+  futureState->errorNumber = errorNumber;
+  futureState->exception = exception;
+  PostMessage(sourceCoreID, [futureState] () {
+    futureState->isReady = true;
+    Fiber *fiber = futureState->waitingFiber;
+    if (fiber != nullptr) {
+      futureState->waitingFiber = nullptr;
+      TheScheduler->resumeFiber(fiber);
+    }
+    if (--CurrentCore->pendingFutureCount == 0 && CoreIsDone(CurrentCore)) {
+      RingDoorbell(CurrentCore);
+    }
+  });
+  Core *core = CurrentCore;
+  if (FetchSub(core->pendingRequestCount, 1u) == 1 && CoreIsDone(core)) {
+    RingDoorbell(core);
+  }
+}
+
+void *CoreStart(void *argument)
+{
+  RunCore(static_cast<Core *>(argument), nullptr);
+  return nullptr;
+}
+
+void RunCore(Core *core, Coroutine &&coroutine)
+{
+  assert(core != nullptr);
+  if (core->cpu >= 0) {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(core->cpu, &cpuSet);
+    xthread_setaffinity_np(pthread_self(), sizeof cpuSet, &cpuSet);
+  }
+  for (int i = 0; i < CoreCount; ++i) {
+    core->incomingRings.push_back(CreateCoreRing());
+  }
+  CurrentCore = core;
+  {
+    Scheduler scheduler;
+    TheScheduler = &scheduler;
+    xthread_barrier_wait(&CoreBarrier);
+    scheduler.watchIO(core->doorbellFD, true);
+    scheduler.callCoroutine([core] () {
+      ServeCore(core);
+    });
+    if (coroutine != nullptr) {
+      scheduler.callCoroutine([&coroutine] () {
+        std::exception_ptr exception = CallInternalCoroutine(coroutine);
+        StopCores();
+        if (exception != nullptr) {
+          std::rethrow_exception(exception);
+        }
+      });
+    }
+    scheduler.run();
+    TheScheduler = nullptr;
+  }
+  CurrentCore = nullptr;
+}
+
+void ServeCore(Core *core)
+{
+  while (!CoreIsDone(core)) {
+    uint64_t doorbellCount;
+    if (Read(core->doorbellFD, &doorbellCount, sizeof doorbellCount, -1) < 0) {
+      TARA_FATALITY_LOG("read failed: ", Error(errno));
+    }
+    for (CoreRing *ring : core->incomingRings) {
+      Coroutine *message;
+      while ((message = PopMessage(ring)) != nullptr) {
+        TheScheduler->callCoroutine(std::move(*message));
+        delete message;
+      }
+    }
+  }
+}
+
+std::exception_ptr CallInternalCoroutine(const Coroutine &coroutine)
+{
+  TheScheduler->forbidQuickExit();
+  try {
+    coroutine();
+  } catch (...) {
+    return std::current_exception();
+  }
+  return nullptr;
+}
+
+void StopCores()
+{
+  for (int i = 0; i < CoreCount; ++i) {
+    PostMessage(i, [] () {
+      Store(CurrentCore->isStopped, true);
+      RingDoorbell(CurrentCore);
+    });
+  }
+}
+
+bool CoreIsDone(const Core *core)
+{
+  return Load(core->isStopped, MemoryOrder::Relaxed) &&
+         core->pendingFutureCount == 0 && Load(core->pendingRequestCount) == 0;
+}
+
+void PostMessage(int coreID, Coroutine &&coroutine)
+{
+  assert(CurrentCore != nullptr);
+  assert(coreID >= 0 && coreID < CoreCount);
+  CoreRing *ring = Cores[coreID].incomingRings[CurrentCore->id];
+  auto message = new Coroutine(std::move(coroutine));
+  while (!PushMessage(ring, message)) {
+    RingDoorbell(&Cores[coreID]);
+    TheScheduler->yieldCurrentFiber();
+  }
+  if (CurrentCore->pendingDoorbells[coreID]) {
+    return;
+  }
+  CurrentCore->pendingDoorbells[coreID] = true;
+  if (!CurrentCore->doorbellFlushIsScheduled) {
+    CurrentCore->doorbellFlushIsScheduled = true;
+    TheScheduler->callCoroutine(FlushDoorbells);
+  }
+}
+
+void FlushDoorbells()
+{
+  Core *core = CurrentCore;
+  core->doorbellFlushIsScheduled = false;
+  for (int i = 0; i < CoreCount; ++i) {
+    if (core->pendingDoorbells[i]) {
+      core->pendingDoorbells[i] = false;
+      RingDoorbell(&Cores[i]);
+    }
+  }
+}
+
+void RingDoorbell(const Core *core)
+{
+  uint64_t doorbellCount = 1;
+  while (write(core->doorbellFD, &doorbellCount, sizeof doorbellCount) < 0) {
+    if (errno == EAGAIN) {
+      break;
+    }
+    if (errno != EINTR) {
+      TARA_FATALITY_LOG("write failed: ", Error(errno));
+    }
+  }
+}
+
+CoreRing *CreateCoreRing()
+{
+  void *memory;
+  int errorNumber = posix_memalign(&memory, alignof(CoreRing),
+                                   sizeof(CoreRing));
+  if (errorNumber != 0) {
+    TARA_FATALITY_LOG("posix_memalign failed: ", Error(errorNumber));
+  }
+  return new (memory) CoreRing();
+}
+
+void DestroyCoreRing(CoreRing *ring)
+{
+  ring->~CoreRing();
+  free(ring);
+}
+
+bool PushMessage(CoreRing *ring, Coroutine *message)
+{
+  unsigned int tail = Load(ring->tail, MemoryOrder::Relaxed);
+  if (tail - Load(ring->head, MemoryOrder::Acquire) ==
+      TARA_CORE_RING_CAPACITY) {
+    return false;
+  }
+  ring->messages[tail % TARA_CORE_RING_CAPACITY] = message;
+  Store(ring->tail, tail + 1, MemoryOrder::Release);
+  return true;
+}
+
+Coroutine *PopMessage(CoreRing *ring)
+{
+  unsigned int head = Load(ring->head, MemoryOrder::Relaxed);
+  if (head == Load(ring->tail, MemoryOrder::Acquire)) {
+    return nullptr;
+  }
+  Coroutine *message = ring->messages[head % TARA_CORE_RING_CAPACITY];
+  Store(ring->head, head + 1, MemoryOrder::Release);
+  return message;
+}
+
+int xeventfd(unsigned int initval, int flags)
+{
+  int fd = eventfd(initval, flags);
+  if (fd < 0) {
+    TARA_FATALITY_LOG("eventfd failed: ", Error(errno));
+  }
+  return fd;
+}
+
+void xclose(int fd)
+{
+  int result;
+  do {
+    result = close(fd);
+    if (result >= 0) {
+      break;
+    }
+  } while (errno == EINTR);
+  if (result < 0) {
+    TARA_FATALITY_LOG("close failed: ", Error(errno));
+  }
+}
+
+void xsched_getaffinity(pid_t pid, size_t cpusetsize, cpu_set_t *mask)
+{
+  if (sched_getaffinity(pid, cpusetsize, mask) < 0) {
+    TARA_FATALITY_LOG("sched_getaffinity failed: ", Error(errno));
+  }
+}
+
+void xthread_setaffinity_np(pthread_t thread, size_t cpusetsize,
+                            const cpu_set_t *cpuset)
+{
+  int errorNumber = pthread_setaffinity_np(thread, cpusetsize, cpuset);
+  if (errorNumber != 0) {
+    TARA_FATALITY_LOG("pthread_setaffinity_np failed: ", Error(errorNumber));
+  }
+}
+
+void xthread_barrier_init(pthread_barrier_t *barrier,
+                          const pthread_barrierattr_t *attr,
+                          unsigned int count)
+{
+  int errorNumber = pthread_barrier_init(barrier, attr, count);
+  if (errorNumber != 0) {
+    TARA_FATALITY_LOG("pthread_barrier_init failed: ", Error(errorNumber));
+  }
+}
+
+void xthread_barrier_destroy(pthread_barrier_t *barrier)
+{
+  int errorNumber = pthread_barrier_destroy(barrier);
+  if (errorNumber != 0) {
+    TARA_FATALITY_LOG("pthread_barrier_destroy failed: ", Error(errorNumber));
+  }
+}
+
+void xthread_barrier_wait(pthread_barrier_t *barrier)
+{
+  int errorNumber = pthread_barrier_wait(barrier);
+  if (errorNumber != 0 && errorNumber != PTHREAD_BARRIER_SERIAL_THREAD) {
+    TARA_FATALITY_LOG("pthread_barrier_wait failed: ", Error(errorNumber));
+  }
+}
+
+void xthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                    void *(*start_routine)(void *), void *arg)
+{
+  int errorNumber = pthread_create(thread, attr, start_routine, arg);
+  if (errorNumber != 0) {
+    TARA_FATALITY_LOG("pthread_create failed: ", Error(errorNumber));
+  }
+}
+
+void xthread_join(pthread_t thread, void **retval)
+{
+  int errorNumber = pthread_join(thread, retval);
+  if (errorNumber != 0) {
+    TARA_FATALITY_LOG("pthread_join failed: ", Error(errorNumber));
+  }
+}
+
+} // namespace
+
+} // namespace Tara
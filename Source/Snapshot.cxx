@@ -0,0 +1,127 @@
+#include "Snapshot.hxx"
+
+#include <assert.h>
+#include <limits.h>
+#
+#include <algorithm>
+#include <vector>
+#
+#include "Atomic.hxx"
+#include "Quiescence.hxx"
+
+namespace Tara {
+
+namespace {
+
+struct QuiescentState final
+{
+  unsigned long epoch;
+};
+
+struct RetiredVersion final
+{
+  void *version;
+  void (*deleter)(void *version);
+  unsigned long epoch;
+};
+
+SpinLock Lock;
+std::vector<QuiescentState *> QuiescentStates;
+std::vector<RetiredVersion> RetiredVersions;
+unsigned long Epoch = 1;
+unsigned int RetiredVersionCount;
+thread_local QuiescentState *CurrentQuiescentState;
+
+void ReclaimVersions();
+
+} // namespace
+
+void RetireSnapshotVersion(void *version, void (*deleter)(void *version))
+{
+  assert(version != nullptr);
+  assert(deleter != nullptr);
+  Lock.lock();
+  unsigned long epoch = FetchAdd(Epoch, 1UL) + 1;
+  RetiredVersions.push_back({version, deleter, epoch});
+  Store(RetiredVersionCount, static_cast<unsigned int>(RetiredVersions.size()),
+        MemoryOrder::Relaxed);
+  Lock.unlock();
+  ReclaimVersions();
+}
+
+void RegisterQuiescentThread()
+{
+  assert(CurrentQuiescentState == nullptr);
+  auto state = new QuiescentState;
+  state->epoch = ULONG_MAX;
+  Lock.lock();
+  QuiescentStates.push_back(state);
+  Lock.unlock();
+  CurrentQuiescentState = state;
+}
+
+void UnregisterQuiescentThread()
+{
+  QuiescentState *state = CurrentQuiescentState;
+  assert(state != nullptr);
+  CurrentQuiescentState = nullptr;
+  Lock.lock();
+  QuiescentStates.erase(std::find(QuiescentStates.begin(),
+                                  QuiescentStates.end(), state));
+  Lock.unlock();
+  delete state;
+  ReclaimVersions();
+}
+
+void EnterQuiescentState()
+{
+  QuiescentState *state = CurrentQuiescentState;
+  assert(state != nullptr);
+  Store(state->epoch, ULONG_MAX, MemoryOrder::Release);
+  if (Load(RetiredVersionCount, MemoryOrder::Relaxed) != 0) {
+    ReclaimVersions();
+  }
+}
+
+void LeaveQuiescentState()
+{
+  QuiescentState *state = CurrentQuiescentState;
+  assert(state != nullptr);
+  Store(state->epoch, Load(Epoch, MemoryOrder::Acquire),
+        MemoryOrder::Relaxed);
+  ThreadFence();
+}
+
+namespace {
+
+void ReclaimVersions()
+{
+  if (!Lock.tryLock()) {
+    return;
+  }
+  ThreadFence();
+  unsigned long minEpoch = ULONG_MAX;
+  for (QuiescentState *state : QuiescentStates) {
+    unsigned long epoch = Load(state->epoch, MemoryOrder::Acquire);
+    if (epoch < minEpoch) {
+      minEpoch = epoch;
+    }
+  }
+  auto versionsEnd = std::partition(RetiredVersions.begin(),
+                                    RetiredVersions.end(),
+                                    [minEpoch] (const RetiredVersion &version) {
+    return version.epoch > minEpoch;
+  });
+  std::vector<RetiredVersion> versions(versionsEnd, RetiredVersions.end());
+  RetiredVersions.erase(versionsEnd, RetiredVersions.end());
+  Store(RetiredVersionCount, static_cast<unsigned int>(RetiredVersions.size()),
+        MemoryOrder::Relaxed);
+  Lock.unlock();
+  for (const RetiredVersion &version : versions) {
+    version.deleter(version.version);
+  }
+}
+
+} // namespace
+
+} // namespace Tara
@@ -0,0 +1,81 @@
+#include "SpawnSite.hxx"
+
+#include <assert.h>
+#
+#include "Utility.hxx"
+
+namespace Tara {
+
+namespace {
+
+unsigned int GetStackUsageIndex(size_t stackUsage);
+size_t GetStackUsageLimit(unsigned int stackUsageIndex);
+
+} // namespace
+
+SpawnSite::SpawnSite(const void *address)
+  : address(address), stackClass(0), stackUsageSampleCount(0),
+    stackUsageCounts(), maxStackUsage(0), fiberCount(0), fiberStatistics()
+{}
+
+void SpawnSite::recordStackUsage(size_t stackUsage)
+{
+  ++stackUsageCounts[GetStackUsageIndex(stackUsage)];
+  ++stackUsageSampleCount;
+  if (stackUsage > maxStackUsage) {
+    maxStackUsage = stackUsage;
+  }
+}
+
+void SpawnSite::recordFiberStatistics(const FiberStatistics &fiberStatistics)
+{
+  ++fiberCount;
+  this->fiberStatistics.switchCount += fiberStatistics.switchCount;
+  this->fiberStatistics.cpuTime += fiberStatistics.cpuTime;
+  this->fiberStatistics.waitTime += fiberStatistics.waitTime;
+  this->fiberStatistics.readByteCount += fiberStatistics.readByteCount;
+  this->fiberStatistics.writtenByteCount += fiberStatistics.writtenByteCount;
+}
+
+size_t SpawnSite::calculateStackUsage(unsigned int percentile) const
+{
+  assert(percentile <= 100);
+  unsigned long long sampleCount = (static_cast<unsigned long long>
+                                    (stackUsageSampleCount) * percentile +
+                                    99) / 100;
+  if (sampleCount == 0) {
+    return 0;
+  }
+  for (int i = 0; i < TARA_LENGTH_OF(stackUsageCounts); ++i) {
+    if (stackUsageCounts[i] >= sampleCount) {
+      size_t stackUsageLimit = GetStackUsageLimit(i);
+      return stackUsageLimit < maxStackUsage ? stackUsageLimit : maxStackUsage;
+    }
+    sampleCount -= stackUsageCounts[i];
+  }
+  return maxStackUsage;
+}
+
+namespace {
+
+unsigned int GetStackUsageIndex(size_t stackUsage)
+{
+  if (stackUsage < 1024) {
+    return 0;
+  }
+  unsigned int octave = 63 - __builtin_clzll(stackUsage) - 10;
+  unsigned int stackUsageIndex = 4 * octave +
+                                 ((stackUsage >> (octave + 8)) & 3);
+  return stackUsageIndex < TARA_LENGTH_OF(SpawnSite::stackUsageCounts) ?
+         stackUsageIndex : TARA_LENGTH_OF(SpawnSite::stackUsageCounts) - 1;
+}
+
+size_t GetStackUsageLimit(unsigned int stackUsageIndex)
+{
+  unsigned int octave = stackUsageIndex / 4;
+  return static_cast<size_t>(5 + stackUsageIndex % 4) << (octave + 8);
+}
+
+} // namespace
+
+} // namespace Tara
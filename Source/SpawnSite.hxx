@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#
+#include "Runtime.hxx"
+
+namespace Tara {
+
+struct SpawnSite final
+{
+  const void *const address;
+  unsigned int stackClass;
+  unsigned int stackUsageSampleCount;
+  unsigned int stackUsageCounts[44];
+  size_t maxStackUsage;
+  unsigned long fiberCount;
+  FiberStatistics fiberStatistics;
+
+  explicit SpawnSite(const void *address);
+
+  void recordStackUsage(size_t stackUsage);
+  void recordFiberStatistics(const FiberStatistics &fiberStatistics);
+  size_t calculateStackUsage(unsigned int percentile) const;
+};
+
+} // namespace Tara
@@ -0,0 +1,266 @@
+#ifdef __cpp_impl_coroutine
+
+#include "Stackless.hxx"
+
+#include <unistd.h>
+#
+#include <stdint.h>
+#include <stdlib.h>
+#
+#include "IOEvent.hxx"
+#include "Log.hxx"
+#include "MemoryPool.hxx"
+#include "ObjectPool.hxx"
+#include "Scheduler.hxx"
+#include "Utility.hxx"
+
+#define TARA_MIN_FRAME_SIZE 128
+
+#define CHECK_THE_SCHEDULER              \
+  do {                                   \
+    if (TheScheduler == nullptr) {       \
+      TARA_FATALITY_LOG("No scheduler"); \
+    }                                    \
+  } while (false)
+
+namespace Tara {
+
+extern thread_local Scheduler *TheScheduler;
+
+namespace Stackless {
+
+namespace {
+
+struct StacklessWaiter final : Waiter
+{
+  std::coroutine_handle<> coroutine;
+  int *result;
+};
+
+class IOEventAwaitable final : public Awaitable
+{
+public:
+  IOEventAwaitable(int fd, IOEvent ioEvent, int timeout)
+    : fd_(fd), ioEvent_(ioEvent), timeout_(timeout) {}
+
+  void await_suspend(std::coroutine_handle<> coroutine);
+
+private:
+  const int fd_;
+  const IOEvent ioEvent_;
+  const int timeout_;
+};
+
+class DetachedTask final
+{
+public:
+  class promise_type final
+  {
+  public:
+    static void *operator new(size_t size) { return AllocateFrame(size); }
+    static void operator delete(void *frame, size_t size)
+    { FreeFrame(frame, size); }
+
+    DetachedTask get_return_object() const noexcept { return {}; }
+    std::suspend_never initial_suspend() const noexcept { return {}; }
+    std::suspend_never final_suspend() const noexcept { return {}; }
+    void return_void() const noexcept {}
+    void unhandled_exception() const noexcept { std::terminate(); }
+  };
+};
+
+thread_local MemoryPool FramePools[] = {
+  {TARA_MIN_FRAME_SIZE << 0, 64},
+  {TARA_MIN_FRAME_SIZE << 1, 64},
+  {TARA_MIN_FRAME_SIZE << 2, 64},
+  {TARA_MIN_FRAME_SIZE << 3, 32},
+  {TARA_MIN_FRAME_SIZE << 4, 16}
+};
+
+thread_local ObjectPool<StacklessWaiter, 256> WaiterPool;
+
+StacklessWaiter *CreateWaiter(void *coroutineAddress, int *result);
+void ResumeWaiter(Waiter *waiter);
+DetachedTask RunTask(Task<> task);
+
+} // namespace
+
+void *AllocateFrame(size_t size)
+{
+  for (int i = 0; i < TARA_LENGTH_OF(FramePools); ++i) {
+    if (size <= TARA_MIN_FRAME_SIZE << i) {
+      return FramePools[i].allocateBlock();
+    }
+  }
+  void *frame = malloc(size);
+  if (frame == nullptr) {
+    TARA_FATALITY_LOG("malloc failed");
+  }
+  return frame;
+}
+
+void FreeFrame(void *frame, size_t size)
+{
+  for (int i = 0; i < TARA_LENGTH_OF(FramePools); ++i) {
+    if (size <= TARA_MIN_FRAME_SIZE << i) {
+      FramePools[i].freeBlock(frame);
+      return;
+    }
+  }
+  free(frame);
+}
+
+void SuspendForYield(void *coroutineAddress, int *status)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->readyWaiter(CreateWaiter(coroutineAddress, status));
+}
+
+void SuspendForSleep(void *coroutineAddress, int *status, int duration)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->sleepWaiter(CreateWaiter(coroutineAddress, status),
+                            duration);
+}
+
+void SuspendForTask(void *coroutineAddress, int *status,
+                    const std::function<void ()> *task)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->submitTask(CreateWaiter(coroutineAddress, status), task);
+}
+
+void Spawn(Task<> &&task)
+{
+  CHECK_THE_SCHEDULER;
+  TheScheduler->addStacklessTask();
+  RunTask(std::move(task));
+}
+
+Task<ssize_t> Read(int fd, void *buf, size_t buflen, int timeout)
+{
+  CHECK_THE_SCHEDULER;
+  if (!TheScheduler->ioIsWatched(fd)) {
+    errno = EBADF;
+    co_return -1;
+  }
+  for (;;) {
+    ssize_t n = read(fd, buf, buflen);
+    if (n >= 0) {
+      co_return n;
+    }
+    if (errno == EWOULDBLOCK) {
+      if (co_await IOEventAwaitable(fd, IOEvent::Readability, timeout) < 0) {
+        co_return -1;
+      }
+      continue;
+    }
+    if (errno != EINTR) {
+      co_return -1;
+    }
+  }
+}
+
+Task<ssize_t> Write(int fd, const void *buf, size_t buflen, int timeout)
+{
+  CHECK_THE_SCHEDULER;
+  if (!TheScheduler->ioIsWatched(fd)) {
+    errno = EBADF;
+    co_return -1;
+  }
+  for (;;) {
+    ssize_t n = write(fd, buf, buflen);
+    if (n >= 0) {
+      co_return n;
+    }
+    if (errno == EWOULDBLOCK) {
+      if (co_await IOEventAwaitable(fd, IOEvent::Writability, timeout) < 0) {
+        co_return -1;
+      }
+      continue;
+    }
+    if (errno != EINTR) {
+      co_return -1;
+    }
+  }
+}
+
+Task<int> Accept4(int fd, sockaddr *addr, socklen_t *addrlen, int flags,
+                  int timeout)
+{
+  CHECK_THE_SCHEDULER;
+  if (!TheScheduler->ioIsWatched(fd)) {
+    errno = EBADF;
+    co_return -1;
+  }
+  uint64_t deadline = timeout < 0 ? UINT64_MAX
+                                  : TheScheduler->getTime() + timeout;
+  for (;;) {
+    int backoff = TheScheduler->calculateBackoff(deadline);
+    if (backoff == 0) {
+      break;
+    }
+    if (backoff < 0) {
+      co_return -1;
+    }
+    co_await Sleep(backoff);
+  }
+  for (;;) {
+    int subfd = accept4(fd, addr, addrlen, flags | SOCK_NONBLOCK);
+    if (subfd >= 0) {
+      TheScheduler->watchIO(subfd);
+      co_return subfd;
+    }
+    if (errno == EWOULDBLOCK) {
+      timeout = TheScheduler->calculateTimeout(deadline);
+      if (co_await IOEventAwaitable(fd, IOEvent::Readability, timeout) < 0) {
+        co_return -1;
+      }
+      continue;
+    }
+    if (errno != EINTR) {
+      co_return -1;
+    }
+  }
+}
+
+namespace {
+
+void IOEventAwaitable::await_suspend(std::coroutine_handle<> coroutine)
+{
+  TheScheduler->watchIOEvent(CreateWaiter(coroutine.address(), &status_), fd_,
+                             ioEvent_, timeout_);
+}
+
+StacklessWaiter *CreateWaiter(void *coroutineAddress, int *result)
+{
+  StacklessWaiter *waiter = WaiterPool.createObject();
+  waiter->resume = ResumeWaiter;
+  waiter->coroutine = std::coroutine_handle<>::from_address(coroutineAddress);
+  waiter->result = result;
+  return waiter;
+}
+
+void ResumeWaiter(Waiter *waiter)
+{
+  auto stacklessWaiter = static_cast<StacklessWaiter *>(waiter);
+  std::coroutine_handle<> coroutine = stacklessWaiter->coroutine;
+  *stacklessWaiter->result = stacklessWaiter->status;
+  WaiterPool.destroyObject(stacklessWaiter);
+  coroutine.resume();
+}
+
+DetachedTask RunTask(Task<> task)
+{
+  co_await Yield();
+  co_await std::move(task);
+  TheScheduler->removeStacklessTask();
+}
+
+} // namespace
+
+} // namespace Stackless
+
+} // namespace Tara
+
+#endif
@@ -1,11 +1,8 @@
 #include "Timer.hxx"
 
 #include <assert.h>
-#include <errno.h>
-#include <time.h>
 #
-#include "Error.hxx"
-#include "Log.hxx"
+#include "Clock.hxx"
 #include "TimerItem.hxx"
 #include "Utility.hxx"
 
@@ -13,22 +10,46 @@ namespace Tara {
 
 namespace {
 
-uint64_t GetTime(void);
-
-void xclock_gettime(clockid_t clock_id, timespec *tp);
 int heap_compare(const heap_node* a, const heap_node* b);
 
 } // namespace
 
 Timer::Timer()
+  : clockIsVirtual_(false), virtualTime_(0), timeOffset_(0)
 {
   heap_init(&itemHeap_);
 }
 
+uint64_t Timer::getTime() const
+{
+  return clockIsVirtual_ ? virtualTime_ : GetTime() + timeOffset_;
+}
+
+void Timer::setVirtualClock(bool enabled)
+{
+  if (enabled == clockIsVirtual_) {
+    return;
+  }
+  if (enabled) {
+    virtualTime_ = getTime();
+  } else {
+    timeOffset_ = virtualTime_ - GetTime();
+  }
+  clockIsVirtual_ = enabled;
+}
+
+void Timer::advanceClock(int duration)
+{
+  assert(clockIsVirtual_);
+  if (duration > 0) {
+    virtualTime_ += duration;
+  }
+}
+
 void Timer::addItem(TimerItem *item, int duration)
 {
   assert(item != nullptr);
-  item->dueTime = duration >= 0 ? GetTime() + duration : UINT64_MAX;
+  item->dueTime = duration >= 0 ? getTime() + duration : UINT64_MAX;
   heap_insert(&itemHeap_, &item->heapNode, heap_compare);
 }
 
@@ -49,7 +70,7 @@ unsigned int Timer::removeDueItems(TimerItem **buffer,
   if (itemHeapNode == nullptr) {
     return 0;
   }
-  uint64_t now = GetTime();
+  uint64_t now = getTime();
   int i = 0;
   for (;;) {
     auto item = TARA_CONTAINER_OF(itemHeapNode, TimerItem, heapNode);
@@ -79,26 +100,12 @@ int Timer::calculateTimeout()
   if (item->dueTime == UINT64_MAX) {
     return -1;
   }
-  uint64_t now = GetTime();
+  uint64_t now = getTime();
   return item->dueTime > now ? item->dueTime - now : 0;
 }
 
 namespace {
 
-uint64_t GetTime(void)
-{
-  timespec time;
-  xclock_gettime(CLOCK_MONOTONIC_COARSE, &time);
-  return time.tv_sec * 1000 + time.tv_nsec / 1000000;
-}
-
-void xclock_gettime(clockid_t clock_id, timespec *tp)
-{
-  if (clock_gettime(clock_id, tp) < 0) {
-    TARA_FATALITY_LOG("clock_gettime failed: ", Error(errno));
-  }
-}
-
 int heap_compare(const heap_node* a, const heap_node* b)
 {
   assert(a != nullptr);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+#
 #include "libuv/heap-inl.h"
 
 namespace Tara {
@@ -14,6 +16,12 @@ class Timer final
 public:
   Timer();
 
+  bool clockIsVirtual() const { return clockIsVirtual_; }
+  unsigned int getItemCount() const { return itemHeap_.nelts; }
+
+  uint64_t getTime() const;
+  void setVirtualClock(bool enabled);
+  void advanceClock(int duration);
   void addItem(TimerItem *item, int duration);
   void removeItem(TimerItem *item);
   unsigned int removeDueItems(TimerItem **buffer, unsigned int bufferLength);
@@ -21,6 +29,9 @@ public:
 
 private:
   heap itemHeap_;
+  bool clockIsVirtual_;
+  uint64_t virtualTime_;
+  uint64_t timeOffset_;
 };
 
 } // namespace Tara
@@ -0,0 +1,352 @@
+#include "Watchdog.hxx"
+
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#
+#include <algorithm>
+#include <vector>
+#
+#include "Atomic.hxx"
+#include "Clock.hxx"
+#include "Error.hxx"
+#include "Log.hxx"
+#include "Runtime.hxx"
+#include "Scheduler.hxx"
+
+#define TARA_WATCHDOG_SIGNAL (SIGRTMIN + 1)
+#define TARA_WATCHDOG_MIN_INTERVAL 1
+#define TARA_WATCHDOG_SIGNAL_STACK_SIZE 65536
+
+namespace Tara {
+
+extern thread_local Scheduler *const TheScheduler;
+
+namespace {
+
+struct WatchedScheduler final
+{
+  Scheduler *scheduler;
+  pthread_t thread;
+  unsigned long heartbeat;
+  uint64_t beatTime;
+  bool stallIsReported;
+  bool isSignalable;
+  unsigned char *signalStack;
+};
+
+struct StallReport final
+{
+  Scheduler *scheduler;
+  uint64_t stall;
+  bool isRecovery;
+  int errorNumber;
+};
+
+SpinLock Lock;
+std::vector<WatchedScheduler> WatchedSchedulers;
+pthread_mutex_t WatchdogMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t WatchdogCondition = PTHREAD_COND_INITIALIZER;
+pthread_t WatchdogThread;
+bool WatchdogIsRunning;
+bool WatchdogHasStarted;
+bool WatchdogIsStopping;
+int Threshold;
+
+void *RunWatchdog(void *argument);
+void CheckSchedulers(uint64_t now, int threshold);
+std::vector<WatchedScheduler>::iterator
+FindWatchedScheduler(const Scheduler *scheduler);
+void WatchdogSignalHandler(int signalNumber, siginfo_t *signalInfo,
+                           void *context);
+void xsigaction(int signum, const struct sigaction *act,
+                struct sigaction *oldact);
+void xsigaltstack(const stack_t *ss, stack_t *oss);
+void xthread_mutex_lock(pthread_mutex_t *mutex);
+void xthread_mutex_unlock(pthread_mutex_t *mutex);
+void xthread_cond_signal(pthread_cond_t *cond);
+void xthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                    void *(*start_routine)(void *), void *arg);
+void xthread_join(pthread_t thread, void **retval);
+
+} // namespace
+
+void RegisterWatchedScheduler(Scheduler *scheduler)
+{
+  assert(scheduler != nullptr);
+  Lock.lock();
+  WatchedSchedulers.push_back({scheduler, pthread_self(), 0, GetTime(),
+                               false, false, nullptr});
+  Lock.unlock();
+}
+
+void UnregisterWatchedScheduler(Scheduler *scheduler)
+{
+  Lock.lock();
+  auto watchedScheduler = FindWatchedScheduler(scheduler);
+  unsigned char *signalStack = watchedScheduler->signalStack;
+  WatchedSchedulers.erase(watchedScheduler);
+  Lock.unlock();
+  if (signalStack != nullptr) {
+    stack_t stack;
+    stack.ss_sp = nullptr;
+    stack.ss_flags = SS_DISABLE;
+    stack.ss_size = 0;
+    xsigaltstack(&stack, nullptr);
+    delete[] signalStack;
+  }
+}
+
+bool PrepareWatchedScheduler(Scheduler *scheduler)
+{
+  if (!Load(WatchdogHasStarted, MemoryOrder::Acquire)) {
+    return false;
+  }
+  unsigned char *signalStack = nullptr;
+  stack_t stack;
+  xsigaltstack(nullptr, &stack);
+  if ((stack.ss_flags & SS_DISABLE) != 0) {
+    signalStack = new unsigned char[TARA_WATCHDOG_SIGNAL_STACK_SIZE];
+    stack.ss_sp = signalStack;
+    stack.ss_flags = 0;
+    stack.ss_size = TARA_WATCHDOG_SIGNAL_STACK_SIZE;
+    xsigaltstack(&stack, nullptr);
+  }
+  Lock.lock();
+  auto watchedScheduler = FindWatchedScheduler(scheduler);
+  watchedScheduler->isSignalable = true;
+  watchedScheduler->signalStack = signalStack;
+  Lock.unlock();
+  return true;
+}
+
+int StartWatchdog(int threshold)
+{
+  if (threshold <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  xthread_mutex_lock(&WatchdogMutex);
+  Threshold = threshold;
+  if (!WatchdogIsRunning) {
+    void *address;
+    // Make backtrace() load its unwinder now rather than in a signal handler.
+    backtrace(&address, 1);
+    struct sigaction action;
+    action.sa_sigaction = WatchdogSignalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+    xsigaction(TARA_WATCHDOG_SIGNAL, &action, nullptr);
+    Store(WatchdogHasStarted, true, MemoryOrder::Release);
+    WatchdogIsStopping = false;
+    xthread_create(&WatchdogThread, nullptr, RunWatchdog, nullptr);
+    WatchdogIsRunning = true;
+  }
+  xthread_mutex_unlock(&WatchdogMutex);
+  if (TheScheduler != nullptr) {
+    TheScheduler->prepareWatchdog();
+  }
+  return 0;
+}
+
+void StopWatchdog()
+{
+  xthread_mutex_lock(&WatchdogMutex);
+  if (!WatchdogIsRunning) {
+    xthread_mutex_unlock(&WatchdogMutex);
+    return;
+  }
+  WatchdogIsStopping = true;
+  xthread_cond_signal(&WatchdogCondition);
+  xthread_mutex_unlock(&WatchdogMutex);
+  xthread_join(WatchdogThread, nullptr);
+  xthread_mutex_lock(&WatchdogMutex);
+  WatchdogIsRunning = false;
+  xthread_mutex_unlock(&WatchdogMutex);
+}
+
+namespace {
+
+void *RunWatchdog(void *argument)
+{
+  static_cast<void>(argument);
+  xthread_mutex_lock(&WatchdogMutex);
+  while (!WatchdogIsStopping) {
+    int threshold = Threshold;
+    int interval = std::max(threshold / 4, TARA_WATCHDOG_MIN_INTERVAL);
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += interval / 1000;
+    deadline.tv_nsec += interval % 1000 * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      ++deadline.tv_sec;
+      deadline.tv_nsec -= 1000000000;
+    }
+    int errorNumber = pthread_cond_timedwait(&WatchdogCondition,
+                                             &WatchdogMutex, &deadline);
+    if (errorNumber != 0 && errorNumber != ETIMEDOUT) {
+      TARA_FATALITY_LOG("pthread_cond_timedwait failed: ",
+                        Error(errorNumber));
+    }
+    if (WatchdogIsStopping) {
+      break;
+    }
+    xthread_mutex_unlock(&WatchdogMutex);
+    CheckSchedulers(GetTime(), threshold);
+    xthread_mutex_lock(&WatchdogMutex);
+  }
+  xthread_mutex_unlock(&WatchdogMutex);
+  return nullptr;
+}
+
+void CheckSchedulers(uint64_t now, int threshold)
+{
+  std::vector<StallReport> stallReports;
+  Lock.lock();
+  for (WatchedScheduler &watchedScheduler : WatchedSchedulers) {
+    Scheduler *scheduler = watchedScheduler.scheduler;
+    unsigned long heartbeat = scheduler->getHeartbeat();
+    if (scheduler->isIdle() || heartbeat != watchedScheduler.heartbeat) {
+      if (watchedScheduler.stallIsReported) {
+        stallReports.push_back({scheduler, now - watchedScheduler.beatTime,
+                                true, 0});
+        watchedScheduler.stallIsReported = false;
+      }
+      watchedScheduler.heartbeat = heartbeat;
+      watchedScheduler.beatTime = now;
+      continue;
+    }
+    if (watchedScheduler.stallIsReported ||
+        now - watchedScheduler.beatTime < threshold) {
+      continue;
+    }
+    int errorNumber = 0;
+    if (watchedScheduler.isSignalable) {
+      sigval value;
+      value.sival_ptr = scheduler;
+      errorNumber = pthread_sigqueue(watchedScheduler.thread,
+                                     TARA_WATCHDOG_SIGNAL, value);
+    }
+    stallReports.push_back({scheduler, now - watchedScheduler.beatTime,
+                            false, errorNumber});
+    watchedScheduler.stallIsReported = true;
+  }
+  Lock.unlock();
+  for (const StallReport &stallReport : stallReports) {
+    if (stallReport.isRecovery) {
+      TARA_WARNING_LOG("scheduler recovered: scheduler=",
+                       stallReport.scheduler, " stall=", stallReport.stall,
+                       "ms");
+      continue;
+    }
+    TARA_WARNING_LOG("scheduler stalled: scheduler=", stallReport.scheduler,
+                     " stall=", stallReport.stall, "ms");
+    if (stallReport.errorNumber != 0) {
+      TARA_ERROR_LOG("pthread_sigqueue failed: ",
+                     Error(stallReport.errorNumber));
+    }
+  }
+}
+
+std::vector<WatchedScheduler>::iterator
+FindWatchedScheduler(const Scheduler *scheduler)
+{
+  auto watchedScheduler = std::find_if(
+    WatchedSchedulers.begin(), WatchedSchedulers.end(),
+    [scheduler] (const WatchedScheduler &watchedScheduler) -> bool {
+      return watchedScheduler.scheduler == scheduler;
+    }
+  );
+  assert(watchedScheduler != WatchedSchedulers.end());
+  return watchedScheduler;
+}
+
+void WatchdogSignalHandler(int signalNumber, siginfo_t *signalInfo,
+                           void *context)
+{
+  static_cast<void>(signalNumber);
+  static_cast<void>(context);
+  Scheduler *scheduler = TheScheduler;
+  if (scheduler != nullptr && scheduler == signalInfo->si_value.sival_ptr) {
+    int errorNumber = errno;
+    scheduler->reportStall();
+    errno = errorNumber;
+  }
+}
+
+void xsigaction(int signum, const struct sigaction *act,
+                struct sigaction *oldact)
+{
+  if (sigaction(signum, act, oldact) < 0) {
+    TARA_FATALITY_LOG("sigaction failed: ", Error(errno));
+  }
+}
+
+void xsigaltstack(const stack_t *ss, stack_t *oss)
+{
+  if (sigaltstack(ss, oss) < 0) {
+    TARA_FATALITY_LOG("sigaltstack failed: ", Error(errno));
+  }
+}
+
+void xthread_mutex_lock(pthread_mutex_t *mutex)
+{
+  int errorNumber;
+  do {
+    errorNumber = pthread_mutex_lock(mutex);
+    if (errorNumber == 0) {
+      break;
+    }
+  } while (errorNumber == EAGAIN);
+  if (errorNumber != 0) {
+    TARA_FATALITY_LOG("pthread_mutex_lock failed: ", Error(errorNumber));
+  }
+}
+
+void xthread_mutex_unlock(pthread_mutex_t *mutex)
+{
+  int errorNumber = pthread_mutex_unlock(mutex);
+  if (errorNumber != 0) {
+    TARA_FATALITY_LOG("pthread_mutex_unlock failed: ", Error(errorNumber));
+  }
+}
+
+void xthread_cond_signal(pthread_cond_t *cond)
+{
+  int errorNumber = pthread_cond_signal(cond);
+  if (errorNumber != 0) {
+    TARA_FATALITY_LOG("pthread_cond_signal failed: ", Error(errorNumber));
+  }
+}
+
+void xthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                    void *(*start_routine)(void *), void *arg)
+{
+  int errorNumber;
+  do {
+    errorNumber = pthread_create(thread, attr, start_routine, arg);
+    if (errorNumber == 0) {
+      break;
+    }
+  } while (errorNumber == EAGAIN);
+  if (errorNumber != 0) {
+    TARA_FATALITY_LOG("pthread_create failed: ", Error(errorNumber));
+  }
+}
+
+void xthread_join(pthread_t thread, void **retval)
+{
+  int errorNumber = pthread_join(thread, retval);
+  if (errorNumber != 0) {
+    TARA_FATALITY_LOG("pthread_join failed: ", Error(errorNumber));
+  }
+}
+
+} // namespace
+
+} // namespace Tara
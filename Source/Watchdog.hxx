@@ -0,0 +1,11 @@
+#pragma once
+
+namespace Tara {
+
+class Scheduler;
+
+void RegisterWatchedScheduler(Scheduler *scheduler);
+void UnregisterWatchedScheduler(Scheduler *scheduler);
+bool PrepareWatchedScheduler(Scheduler *scheduler);
+
+} // namespace Tara